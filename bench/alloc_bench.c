@@ -0,0 +1,161 @@
+#define _XOPEN_SOURCE 700   // clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "sim_config.h"
+#include "page_alloc.h"
+
+// Page allocator throughput: every thread repeatedly allocates a small batch
+// of pages and releases them again, so each op goes to the shared free list.
+// Batch modes move the whole batch with page_alloc_n / page_free_n.
+#define BATCH 8
+
+typedef struct BenchArgs {
+    PageAllocator* pa;
+    size_t iters;
+    int bulk;
+    pthread_barrier_t* start;
+} BenchArgs;
+
+static void* bench_thread(void* arg) {
+    BenchArgs* a = (BenchArgs*) arg;
+    Page* held[BATCH];
+    pthread_barrier_wait(a->start);
+    for (size_t i = 0; i < a->iters; ++i) {
+        if (a->bulk) {
+            if (page_alloc_n(a->pa, held, BATCH) != BATCH) abort();
+            page_free_n(a->pa, held, BATCH);
+            continue;
+        }
+        for (size_t j = 0; j < BATCH; ++j) {
+            held[j] = page_alloc(a->pa);
+            if (!held[j]) abort();   // arena sized far above threads * BATCH
+        }
+        for (size_t j = 0; j < BATCH; ++j) page_dec_ref(a->pa, held[j]);
+    }
+    return NULL;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+// Returns millions of alloc+free pairs per second across all threads.
+static double run(const SimConfig* cfg, size_t threads, size_t iters, int bulk) {
+    PageAllocator* pa = page_allocator_create(cfg);
+    pthread_t* tids = (pthread_t*) malloc(threads * sizeof(pthread_t));
+    BenchArgs* args = (BenchArgs*) malloc(threads * sizeof(BenchArgs));
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, (unsigned) threads + 1);
+
+    for (size_t t = 0; t < threads; ++t) {
+        args[t].pa    = pa;
+        args[t].iters = iters;
+        args[t].bulk  = bulk;
+        args[t].start = &start;
+        pthread_create(&tids[t], NULL, bench_thread, &args[t]);
+    }
+    double t0 = now_sec();
+    pthread_barrier_wait(&start);
+    for (size_t t = 0; t < threads; ++t) pthread_join(tids[t], NULL);
+    double secs = now_sec() - t0;
+
+    pthread_barrier_destroy(&start);
+    free(args);
+    free(tids);
+    page_allocator_destroy(pa);
+    return (double) (threads * iters * BATCH) / secs / 1e6;
+}
+
+// Startup of the simulator's model (128 KiB pages): an eager arena writes a
+// descriptor and free list slot for every page in page_allocator_create, a
+// segmented one only for the first segment, on the first allocation. Eager
+// arenas past physical memory are refused by the default overcommit
+// heuristic, so they stop at 4 GiB.
+static void startup(void) {
+    SimConfig cfg = {0};
+    cfg.num_layers      = 4;
+    cfg.num_heads       = 8;
+    cfg.head_dim        = 64;
+    cfg.tokens_per_page = 16;
+    cfg.freelist        = PAGE_FREELIST_LOCKFREE;
+
+    static const struct {
+        size_t arena_gib;
+        size_t segment_mib;   // 0 => eager
+    } runs[] = {
+        { 1,   0 },
+        { 4,   0 },
+        { 4,   1024 },
+        { 64,  1024 },
+        { 512, 1024 },
+    };
+    printf("\n%-10s %10s %12s %14s %16s\n", "arena GiB", "segment", "create us",
+           "1st alloc us", "pages described");
+    for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); ++i) {
+        cfg.arena_bytes         = runs[i].arena_gib << 30;
+        cfg.arena_segment_bytes = runs[i].segment_mib << 20;
+        double t0 = now_sec();
+        PageAllocator* pa = page_allocator_create(&cfg);
+        double t1 = now_sec();
+        Page* p = page_alloc(pa);
+        double t2 = now_sec();
+        if (!p) abort();
+        char seg[32];
+        if (runs[i].segment_mib == 0) snprintf(seg, sizeof(seg), "eager");
+        else snprintf(seg, sizeof(seg), "%zu MiB", runs[i].segment_mib);
+        printf("%-10zu %10s %12.1f %14.1f %16zu\n", runs[i].arena_gib, seg,
+               (t1 - t0) * 1e6, (t2 - t1) * 1e6, page_allocator_stats(pa).pages_open);
+        page_dec_ref(pa, p);
+        page_allocator_destroy(pa);
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t iters = argc > 1 ? (size_t) strtoul(argv[1], NULL, 10) : 20000;
+
+    // Tiny pages: the arena is only here to back descriptors.
+    SimConfig cfg = {0};
+    cfg.num_layers      = 1;
+    cfg.num_heads       = 1;
+    cfg.head_dim        = 8;
+    cfg.tokens_per_page = 16;
+    cfg.arena_bytes     = (size_t) 64 << 20;
+
+    static const struct {
+        const char* name;
+        PageFreeList freelist;
+        size_t cache_pages;
+        int bulk;
+    } modes[] = {
+        { "mutex",          PAGE_FREELIST_MUTEX,    0,  0 },
+        { "mutex/batch",    PAGE_FREELIST_MUTEX,    0,  1 },
+        { "lockfree",       PAGE_FREELIST_LOCKFREE, 0,  0 },
+        { "lockfree/batch", PAGE_FREELIST_LOCKFREE, 0,  1 },
+        { "lockfree+mag",   PAGE_FREELIST_LOCKFREE, 64, 0 },
+        { "bitmap",         PAGE_FREELIST_BITMAP,   0,  0 },
+        { "bitmap/batch",   PAGE_FREELIST_BITMAP,   0,  1 },
+    };
+    static const size_t thread_counts[] = { 1, 2, 4, 8, 16, 32, 64 };
+    const size_t num_modes = sizeof(modes) / sizeof(modes[0]);
+
+    printf("Mops/s (alloc+free pairs)\n%-8s", "threads");
+    for (size_t m = 0; m < num_modes; ++m) printf(" %14s", modes[m].name);
+    printf("\n");
+    for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]); ++i) {
+        printf("%-8zu", thread_counts[i]);
+        for (size_t m = 0; m < num_modes; ++m) {
+            cfg.freelist         = modes[m].freelist;
+            cfg.page_cache_pages = modes[m].cache_pages;
+            printf(" %14.2f", run(&cfg, thread_counts[i], iters, modes[m].bulk));
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+    startup();
+    return 0;
+}
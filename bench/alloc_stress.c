@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "sim_config.h"
+#include "page_alloc.h"
+
+// Page allocator stress: threads allocate and free random batches while
+// reclaims give free pages back to the kernel, for every free-list,
+// magazine and reclaim combination, on an eager arena and on one opened in
+// small segments. Each thread stamps the pages it holds and checks the
+// stamp before freeing them, so a page handed out twice or released while
+// held shows up as corruption. Meant to run under a sanitizer
+// (`make stress`).
+#define THREADS 4
+#define HELD 64
+#define ITERS 20000
+#define STAMP_BYTES 64
+
+typedef struct StressArgs {
+    PageAllocator* pa;
+    unsigned seed;
+    int corrupt;
+} StressArgs;
+
+static void* stress_thread(void* arg) {
+    StressArgs* a = (StressArgs*) arg;
+    unsigned char stamp = (unsigned char) a->seed;
+    Page* held[HELD];
+    size_t n = 0;
+    for (size_t it = 0; it < ITERS; ++it) {
+        if (n < HELD && (rand_r(&a->seed) & 1)) {
+            size_t want = 1 + rand_r(&a->seed) % 8;
+            if (want > HELD - n) want = HELD - n;
+            size_t got = page_alloc_n(a->pa, held + n, want);
+            for (size_t i = n; i < n + got; ++i) memset(page_data(held[i]), stamp, STAMP_BYTES);
+            n += got;
+        } else if (n > 0) {
+            size_t k = 1 + rand_r(&a->seed) % n;
+            for (size_t i = n - k; i < n; ++i) {
+                const unsigned char* d = (const unsigned char*) page_data(held[i]);
+                for (size_t j = 0; j < STAMP_BYTES; ++j) a->corrupt |= d[j] != stamp;
+            }
+            page_free_n(a->pa, held + n - k, k);
+            n -= k;
+        }
+        // What RECLAIM_ON_FINISH does when a sequence finishes.
+        if (it % 256 == 0) page_allocator_reclaim(a->pa, 0);
+    }
+    page_free_n(a->pa, held, n);
+    return NULL;
+}
+
+// One allocator, THREADS threads; the arena holds every page they can hold
+// at once, so no allocation may fail and none may be left in use.
+static int run(const SimConfig* cfg, const char* name) {
+    PageAllocator* pa = page_allocator_create(cfg);
+    pthread_t tids[THREADS];
+    StressArgs args[THREADS];
+    for (size_t t = 0; t < THREADS; ++t) {
+        args[t].pa      = pa;
+        args[t].seed    = (unsigned) t + 1;
+        args[t].corrupt = 0;
+        pthread_create(&tids[t], NULL, stress_thread, &args[t]);
+    }
+    int corrupt = 0;
+    for (size_t t = 0; t < THREADS; ++t) {
+        pthread_join(tids[t], NULL);
+        corrupt |= args[t].corrupt;
+    }
+    page_allocator_drain_cache(pa);
+    PageAllocatorStats s = page_allocator_stats(pa);
+    page_allocator_destroy(pa);
+    printf("%-28s reclaimed %6zu pages in %5zu calls, %6zu reused\n", name,
+           s.reclaimed_pages, s.reclaim_calls, s.reclaim_reuses);
+    int ok = !corrupt && s.pages_in_use == 0 && s.failed_allocs == 0;
+    if (!ok) {
+        fprintf(stderr, "%s: corrupt %d, in use %zu, failed allocs %zu\n", name, corrupt,
+                s.pages_in_use, s.failed_allocs);
+    }
+    return ok;
+}
+
+// A segmented arena hands out every page exactly once, then fails. The
+// pages (1536 bytes) do not divide the system page, so segment bounds fall
+// mid-page.
+static int exhaust(PageFreeList freelist) {
+    SimConfig cfg = {0};
+    cfg.num_layers          = 1;
+    cfg.num_heads           = 1;
+    cfg.head_dim            = 24;
+    cfg.tokens_per_page     = 16;
+    cfg.arena_bytes         = (size_t) 1000 * 1536;
+    cfg.arena_segment_bytes = (size_t) 37 * 1536;
+    cfg.freelist            = freelist;
+    PageAllocator* pa = page_allocator_create(&cfg);
+    size_t n = page_allocator_num_pages(pa);
+    size_t page_bytes = page_allocator_page_bytes(pa);
+    Page** all = (Page**) malloc(n * sizeof(Page*));
+    if (!all) abort();
+
+    size_t got = page_alloc_n(pa, all, 10);
+    while (got < n) {
+        Page* p = page_alloc(pa);
+        if (!p) break;
+        all[got++] = p;
+    }
+    for (size_t i = 0; i < got; ++i) memset(page_data(all[i]), 1, page_bytes);
+    Page* extra = page_alloc(pa);
+    size_t open = page_allocator_stats(pa).pages_open;
+    int ok = got == n && !extra && open == n;
+    if (!ok) {
+        fprintf(stderr, "exhaust: got %zu of %zu pages, %zu described, extra %s\n", got, n,
+                open, extra ? "handed out" : "refused");
+    }
+    if (extra) page_dec_ref(pa, extra);
+    page_free_n(pa, all, got);
+    page_allocator_destroy(pa);
+    free(all);
+    return ok;
+}
+
+static int cmp_page_data(const void* a, const void* b) {
+    const char* x = (const char*) page_data(*(Page* const*) a);
+    const char* y = (const char*) page_data(*(Page* const*) b);
+    return (x > y) - (x < y);
+}
+
+// Takes every page of a 64-page arena, written, in address order.
+static PageAllocator* fill_small(PageFreeList freelist, PageReclaim reclaim, Page** all) {
+    SimConfig cfg = {0};
+    cfg.num_layers            = 1;
+    cfg.num_heads             = 1;
+    cfg.head_dim              = 64;
+    cfg.tokens_per_page       = 16;
+    cfg.arena_bytes           = (size_t) 64 * 4096;
+    cfg.freelist              = freelist;
+    cfg.reclaim               = reclaim;
+    cfg.reclaim_min_run_bytes = 1;
+    PageAllocator* pa = page_allocator_create(&cfg);
+    for (size_t i = 0; i < 64; ++i) {
+        all[i] = page_alloc(pa);
+        if (!all[i]) abort();
+        memset(page_data(all[i]), 1, page_allocator_page_bytes(pa));
+    }
+    qsort(all, 64, sizeof(Page*), cmp_page_data);
+    return pa;
+}
+
+// A full arena with a few short holes, wherever the bitmap's rover was
+// left: one page_alloc_n of exactly the free count gets every hole.
+static int fragmented(PageFreeList freelist) {
+    int ok = 1;
+    for (size_t shift = 0; shift < 16; ++shift) {
+        Page* all[64];
+        PageAllocator* pa = fill_small(freelist, RECLAIM_NONE, all);
+        Page* holes[8];
+        for (size_t k = 0; k < 8; ++k) {
+            size_t i = (shift + k / 2 * 16 + k % 2) % 64;
+            holes[k] = all[i];
+            all[i] = NULL;
+        }
+        page_free_n(pa, holes, 8);
+        size_t got = page_alloc_n(pa, holes, 8);
+        if (got != 8) {
+            fprintf(stderr, "fragmented, shift %zu: got %zu of 8 free pages\n", shift, got);
+            ok = 0;
+        }
+        page_free_n(pa, holes, got);
+        for (size_t i = 0; i < 64; ++i) if (all[i]) page_dec_ref(pa, all[i]);
+        page_allocator_destroy(pa);
+    }
+    return ok;
+}
+
+// A reclaim takes every free page off the list, wherever the bitmap's rover
+// was left, so every committed free page of a full arena with one page in
+// eight held is given back.
+static int reclaim_all(PageFreeList freelist) {
+    int ok = 1;
+    for (size_t shift = 0; shift < 8; ++shift) {
+        Page* all[64];
+        PageAllocator* pa = fill_small(freelist, RECLAIM_ON_FINISH, all);
+        Page* held[8];
+        size_t num_held = 0;
+        for (size_t i = 0; i < 64; ++i) {
+            if (i % 8 == shift) held[num_held++] = all[i];
+            else page_dec_ref(pa, all[i]);
+        }
+        page_allocator_reclaim(pa, 0);
+        PageAllocatorStats s = page_allocator_stats(pa);
+        if (s.committed_free != 0 || s.reclaimed_pages != 64 - num_held) {
+            fprintf(stderr, "reclaim_all, shift %zu: released %zu of %zu, %zu still committed\n",
+                    shift, s.reclaimed_pages, 64 - num_held, s.committed_free);
+            ok = 0;
+        }
+        page_free_n(pa, held, num_held);
+        page_allocator_destroy(pa);
+    }
+    return ok;
+}
+
+int main(void) {
+    // 4 KiB pages, so every page can be released on its own.
+    SimConfig cfg = {0};
+    cfg.num_layers            = 1;
+    cfg.num_heads             = 1;
+    cfg.head_dim              = 64;
+    cfg.tokens_per_page       = 16;
+    cfg.arena_bytes           = (size_t) 512 * 4096;
+    cfg.reclaim_high_water    = 16;
+    cfg.reclaim_min_run_bytes = 1;   // rounded up to one reclaim unit
+
+    static const struct {
+        const char* name;
+        PageFreeList freelist;
+    } modes[] = {
+        { "mutex",    PAGE_FREELIST_MUTEX },
+        { "lockfree", PAGE_FREELIST_LOCKFREE },
+        { "bitmap",   PAGE_FREELIST_BITMAP },   // ignores the magazine
+    };
+    static const struct {
+        const char* name;
+        PageReclaim reclaim;
+    } policies[] = {
+        { "none",       RECLAIM_NONE },
+        { "on finish",  RECLAIM_ON_FINISH },
+        { "high water", RECLAIM_HIGH_WATER },
+    };
+    int ok = 1;
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m) {
+        ok &= exhaust(modes[m].freelist);
+        ok &= fragmented(modes[m].freelist);
+        ok &= reclaim_all(modes[m].freelist);
+        for (size_t seg = 0; seg < 2; ++seg) {
+            for (size_t mag = 0; mag < 2; ++mag) {
+                for (size_t r = 0; r < sizeof(policies) / sizeof(policies[0]); ++r) {
+                    cfg.freelist            = modes[m].freelist;
+                    cfg.arena_segment_bytes = seg ? (size_t) 37 * 4096 : 0;
+                    cfg.page_cache_pages    = mag ? 8 : 0;
+                    cfg.reclaim             = policies[r].reclaim;
+                    char name[64];
+                    snprintf(name, sizeof(name), "%s%s%s, %s", modes[m].name, seg ? "/seg" : "",
+                             mag ? "+mag" : "", policies[r].name);
+                    ok &= run(&cfg, name);
+                }
+            }
+        }
+    }
+    return ok ? 0 : 1;
+}
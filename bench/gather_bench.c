@@ -0,0 +1,291 @@
+#define _XOPEN_SOURCE 700   // clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "sim_config.h"
+#include "page_alloc.h"
+
+// Gather throughput over paged KV, with the arena on base pages and on huge
+// pages. Every arena page is handed out once and the block tables are
+// shuffled, like the free list after hours of churn, so a sequence's pages
+// are scattered over the whole arena. Two access patterns:
+//   full  streams every byte of every page (attention over all heads)
+//   head  reads one head's K vector per token, a 128-byte read every
+//         bytes_per_token, so nearly every read needs a new TLB entry on
+//         base pages
+// A token's KV is laid out [layer][K/V][head][head_dim] in fp16.
+//
+// The churn table then lets the free list place the pages itself: sequences
+// of 256-4096 tokens decode round-robin, one page per tokens_per_page, and
+// are replaced as they finish. The LIFO stack hands each one whatever was
+// freed last; the bitmap (PAGE_FREELIST_BITMAP) extends its last page.
+#define SEQ_PAGES 128   // 2048-token sequences at 16 tokens per page
+#define CHURN_MIN_TOKENS 256
+#define CHURN_MAX_TOKENS 4096
+#define CHURN_MAX_PAGES  (CHURN_MAX_TOKENS / 16)
+
+static volatile uint64_t sink_out;   // keeps the sums from being optimized out
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static const char* arena_pages_name(ArenaPages p) {
+    switch (p) {
+    case ARENA_PAGES_HUGETLB: return "hugetlb";
+    case ARENA_PAGES_THP:     return "thp (advised)";
+    case ARENA_PAGES_BASE:
+    default:                  return "base pages";
+    }
+}
+
+static const char* freelist_name(PageFreeList f) {
+    switch (f) {
+    case PAGE_FREELIST_MUTEX:    return "mutex";
+    case PAGE_FREELIST_BITMAP:   return "bitmap";
+    case PAGE_FREELIST_LOCKFREE:
+    default:                     return "lockfree";
+    }
+}
+
+static uint64_t gather_full(Page** table, size_t n, size_t page_bytes) {
+    uint64_t sum = 0;
+    for (size_t p = 0; p < n; ++p) {
+        const uint64_t* w = (const uint64_t*) page_data(table[p]);
+        for (size_t i = 0; i < page_bytes / sizeof(uint64_t); ++i) sum += w[i];
+    }
+    return sum;
+}
+
+static uint64_t gather_head(Page** table, size_t n, const SimConfig* cfg, size_t head) {
+    size_t bpt = bytes_per_token(cfg);
+    size_t vec = cfg->head_dim * 2;
+    size_t offset = head * vec;   // layer 0, K
+    uint64_t sum = 0;
+    for (size_t p = 0; p < n; ++p) {
+        const unsigned char* base = page_data(table[p]) + offset;
+        for (size_t t = 0; t < cfg->tokens_per_page; ++t) {
+            const uint64_t* w = (const uint64_t*) (base + t * bpt);
+            for (size_t i = 0; i < vec / sizeof(uint64_t); ++i) sum += w[i];
+        }
+    }
+    return sum;
+}
+
+static void run(const SimConfig* cfg, size_t passes) {
+    PageAllocator* pa = page_allocator_create(cfg);
+    size_t n = page_allocator_num_pages(pa);
+    size_t page_bytes = page_allocator_page_bytes(pa);
+    Page** table = (Page**) malloc(n * sizeof(Page*));
+    if (!table) abort();
+    if (page_alloc_n(pa, table, n) != n) abort();
+
+    double t0 = now_sec();
+    for (size_t i = 0; i < n; ++i) memset(page_data(table[i]), (int) (i & 0xff), page_bytes);
+    double fault_secs = now_sec() - t0;
+
+    srand(1);
+    for (size_t i = n; i > 1; --i) {
+        size_t j = (size_t) rand() % i;
+        Page* tmp = table[i - 1];
+        table[i - 1] = table[j];
+        table[j] = tmp;
+    }
+
+    uint64_t sink = 0;
+    t0 = now_sec();
+    for (size_t r = 0; r < passes; ++r) {
+        for (size_t s = 0; s + SEQ_PAGES <= n; s += SEQ_PAGES) {
+            sink += gather_full(table + s, SEQ_PAGES, page_bytes);
+        }
+    }
+    double full_secs = now_sec() - t0;
+    double full_bytes = (double) passes * (double) (n / SEQ_PAGES * SEQ_PAGES) * (double) page_bytes;
+
+    size_t heads = cfg->num_heads;
+    t0 = now_sec();
+    for (size_t r = 0; r < passes; ++r) {
+        for (size_t h = 0; h < heads; ++h) {
+            for (size_t s = 0; s + SEQ_PAGES <= n; s += SEQ_PAGES) {
+                sink += gather_head(table + s, SEQ_PAGES, cfg, h);
+            }
+        }
+    }
+    double head_secs = now_sec() - t0;
+    double head_tokens = (double) passes * (double) heads
+                       * (double) (n / SEQ_PAGES * SEQ_PAGES) * (double) cfg->tokens_per_page;
+
+    size_t huge = page_allocator_huge_page_bytes(pa);
+    sink_out = sink;
+    printf("%-15s %8zu %10.2f %10.2f %12.1f %10.3f\n",
+           arena_pages_name(page_allocator_arena_pages(pa)), huge >> 10,
+           fault_secs > 0.0 ? (double) (n * page_bytes) / fault_secs / 1e9 : 0.0,
+           full_secs > 0.0 ? full_bytes / full_secs / 1e9 : 0.0,
+           head_secs > 0.0 ? head_tokens / head_secs / 1e6 : 0.0,
+           (double) (n * page_bytes) / (double) (1 << 30));
+
+    page_free_n(pa, table, n);
+    free(table);
+    page_allocator_destroy(pa);
+}
+
+typedef struct ChurnSeq {
+    Page* table[CHURN_MAX_PAGES];
+    size_t pages;
+    size_t tokens;
+    size_t target;
+} ChurnSeq;
+
+static uint64_t churn_rng = 1;
+
+static size_t churn_rand(size_t lo, size_t hi) {
+    churn_rng ^= churn_rng << 13;
+    churn_rng ^= churn_rng >> 7;
+    churn_rng ^= churn_rng << 17;
+    return lo + (size_t) (churn_rng % (hi - lo + 1));
+}
+
+// A new sequence with its prompt's pages in one batch. Returns 0 if the
+// arena is out of pages.
+static int churn_start(PageAllocator* pa, ChurnSeq* s, size_t tpp) {
+    s->target = churn_rand(CHURN_MIN_TOKENS, CHURN_MAX_TOKENS);
+    s->tokens = churn_rand(s->target / 8, s->target / 2);
+    s->pages = (s->tokens + tpp - 1) / tpp;
+    if (page_alloc_after(pa, NULL, s->table, s->pages) == s->pages) return 1;
+    page_free_n(pa, s->table, s->pages);
+    s->pages = s->tokens = 0;
+    return 0;
+}
+
+// One decode token; finished sequences (and ones the arena cannot grow)
+// are freed and replaced.
+static void churn_step(PageAllocator* pa, ChurnSeq* s, size_t tpp, size_t* retired) {
+    if (s->tokens == s->pages * tpp) {
+        const Page* last = s->pages > 0 ? s->table[s->pages - 1] : NULL;
+        if (s->tokens < s->target && page_alloc_after(pa, last, &s->table[s->pages], 1) == 1) {
+            s->pages++;
+        } else {
+            s->target = s->tokens;
+        }
+    }
+    if (s->tokens < s->target) {
+        s->tokens++;
+        return;
+    }
+    page_free_n(pa, s->table, s->pages);
+    (*retired)++;
+    churn_start(pa, s, tpp);
+}
+
+static void churn(const SimConfig* cfg, size_t passes) {
+    PageAllocator* pa = page_allocator_create(cfg);
+    size_t n = page_allocator_num_pages(pa);
+    size_t page_bytes = page_allocator_page_bytes(pa);
+    size_t tpp = cfg->tokens_per_page;
+
+    // Fault the whole arena in first, so the timings are the free list's.
+    Page** all = (Page**) malloc(n * sizeof(Page*));
+    if (!all) abort();
+    if (page_alloc_n(pa, all, n) != n) abort();
+    for (size_t i = 0; i < n; ++i) memset(page_data(all[i]), (int) (i & 0xff), page_bytes);
+    page_free_n(pa, all, n);
+    free(all);
+
+    // About half the arena in use at a time.
+    size_t live = n / 200 > 0 ? n / 200 : 1;
+    ChurnSeq* seqs = (ChurnSeq*) calloc(live, sizeof(ChurnSeq));
+    if (!seqs) abort();
+    churn_rng = 88172645463325252ull;
+    for (size_t i = 0; i < live; ++i) churn_start(pa, &seqs[i], tpp);
+
+    size_t retired = 0;
+    while (retired < 8 * live) {
+        for (size_t i = 0; i < live; ++i) churn_step(pa, &seqs[i], tpp, &retired);
+    }
+    size_t tokens = 0;
+    double t0 = now_sec();
+    while (tokens < ((size_t) 4 << 20)) {
+        for (size_t i = 0; i < live; ++i) churn_step(pa, &seqs[i], tpp, &retired);
+        tokens += live;
+    }
+    double churn_secs = now_sec() - t0;
+
+    size_t pages = 0, runs = 0, whole = 0;
+    for (size_t i = 0; i < live; ++i) {
+        size_t r = seqs[i].pages > 0;
+        for (size_t j = 1; j < seqs[i].pages; ++j) {
+            r += page_data(seqs[i].table[j]) != page_data(seqs[i].table[j - 1]) + page_bytes;
+        }
+        pages += seqs[i].pages;
+        runs += r;
+        whole += r == 1;
+    }
+
+    uint64_t sink = 0;
+    t0 = now_sec();
+    for (size_t r = 0; r < passes; ++r) {
+        for (size_t i = 0; i < live; ++i) sink += gather_full(seqs[i].table, seqs[i].pages, page_bytes);
+    }
+    double full_secs = now_sec() - t0;
+    t0 = now_sec();
+    for (size_t r = 0; r < passes; ++r) {
+        for (size_t h = 0; h < cfg->num_heads; ++h) {
+            for (size_t i = 0; i < live; ++i) sink += gather_head(seqs[i].table, seqs[i].pages, cfg, h);
+        }
+    }
+    double head_secs = now_sec() - t0;
+    sink_out = sink;
+
+    double full_bytes = (double) passes * (double) pages * (double) page_bytes;
+    double head_tokens = (double) passes * (double) cfg->num_heads * (double) pages * (double) tpp;
+    printf("%-15s %-9s %9.1f %9.1f %8.0f%% %10.2f %12.1f\n",
+           arena_pages_name(page_allocator_arena_pages(pa)), freelist_name(cfg->freelist),
+           (double) churn_secs * 1e9 / (double) tokens,
+           runs > 0 ? (double) pages / (double) runs : 0.0,
+           live > 0 ? 100.0 * (double) whole / (double) live : 0.0,
+           full_secs > 0.0 ? full_bytes / full_secs / 1e9 : 0.0,
+           head_secs > 0.0 ? head_tokens / head_secs / 1e6 : 0.0);
+
+    for (size_t i = 0; i < live; ++i) page_free_n(pa, seqs[i].table, seqs[i].pages);
+    free(seqs);
+    page_allocator_destroy(pa);
+}
+
+int main(int argc, char** argv) {
+    size_t arena_mib = argc > 1 ? (size_t) strtoul(argv[1], NULL, 10) : 2048;
+    size_t passes    = argc > 2 ? (size_t) strtoul(argv[2], NULL, 10) : 3;
+
+    // The simulator's default model: 8 KiB per token, 128 KiB pages.
+    SimConfig cfg = {0};
+    cfg.num_layers      = 4;
+    cfg.num_heads       = 8;
+    cfg.head_dim        = 64;
+    cfg.tokens_per_page = 16;
+    cfg.arena_bytes     = arena_mib << 20;
+    cfg.freelist        = PAGE_FREELIST_LOCKFREE;
+
+    static const ArenaBacking backings[] = { ARENA_BASE_PAGES, ARENA_HUGE_PAGES };
+    printf("%-15s %8s %10s %10s %12s %10s\n",
+           "arena", "huge KiB", "fault GB/s", "full GB/s", "head Mtok/s", "GiB");
+    for (size_t i = 0; i < sizeof(backings) / sizeof(backings[0]); ++i) {
+        cfg.arena_backing = backings[i];
+        run(&cfg, passes);
+    }
+
+    static const PageFreeList lists[] = { PAGE_FREELIST_LOCKFREE, PAGE_FREELIST_BITMAP };
+    printf("\n%-15s %-9s %9s %9s %9s %10s %12s\n",
+           "arena", "freelist", "ns/token", "pages/run", "contig", "full GB/s", "head Mtok/s");
+    for (size_t i = 0; i < sizeof(backings) / sizeof(backings[0]); ++i) {
+        for (size_t j = 0; j < sizeof(lists) / sizeof(lists[0]); ++j) {
+            cfg.arena_backing = backings[i];
+            cfg.freelist = lists[j];
+            churn(&cfg, passes);
+        }
+    }
+    return 0;
+}
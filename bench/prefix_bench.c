@@ -0,0 +1,88 @@
+#define _XOPEN_SOURCE 700   // clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "sim_config.h"
+#include "workload.h"
+#include "kv_backend.h"
+#include "page_kv.h"
+
+// Prefix lookup cost: fill each prefix cache by running every request once,
+// then time kv_init_sequence (the lookup) plus kv_finish_sequence on a
+// second pass over the same requests, where every full prompt page can hit.
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static void populate(KVBackend* b, const SimConfig* cfg, const SequenceWork* work) {
+    for (size_t i = 0; i < cfg->num_sequences; ++i) {
+        SeqId id;
+        if (kv_init_sequence(b, &work[i], &id) != KV_OK) abort();
+        size_t tokens = work[i].prompt_tokens + work[i].gen_tokens;
+        for (size_t t = 0; t < tokens; ++t) {
+            if (kv_append_token(b, id) != KV_OK) abort();
+        }
+        kv_finish_sequence(b, id);
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? (size_t) strtoul(argv[1], NULL, 10) : 16384;
+
+    // Tiny pages so 100k+ of them fit a small arena.
+    SimConfig cfg = {0};
+    cfg.num_layers         = 1;
+    cfg.num_heads          = 1;
+    cfg.head_dim           = 8;
+    cfg.max_context_tokens = 512;
+    cfg.tokens_per_page    = 16;
+    cfg.arena_bytes        = (size_t) 256 << 20;
+    cfg.freelist           = PAGE_FREELIST_LOCKFREE;
+    cfg.num_sequences      = n;
+    cfg.num_groups         = 1024;
+    cfg.max_prompt_extra   = 128;
+    cfg.min_gen_tokens     = 32;
+    cfg.max_gen_tokens     = 64;
+    cfg.conversation_turns = 4;
+
+    srand(1);
+    SequenceWork* work = generate_workload(&cfg);
+
+    static const struct {
+        const char* name;
+        PrefixCacheMode mode;
+    } modes[] = {
+        { "groups", PREFIX_CACHE_GROUPS },
+        { "radix",  PREFIX_CACHE_RADIX },
+        { "hash",   PREFIX_CACHE_HASH },
+    };
+
+    printf("%-8s %12s %12s %10s\n", "mode", "cached_pages", "ns/lookup", "hit_rate");
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m) {
+        cfg.prefix_cache = modes[m].mode;
+        KVBackend* b = create_paged_backend(&cfg);
+        populate(b, &cfg, work);
+        KVCounters before = kv_counters(b);
+
+        size_t prompt = 0;
+        double t0 = now_sec();
+        for (size_t i = 0; i < n; ++i) {
+            SeqId id;
+            if (kv_init_sequence(b, &work[i], &id) != KV_OK) abort();
+            kv_finish_sequence(b, id);
+            prompt += work[i].prompt_tokens;
+        }
+        double secs = now_sec() - t0;
+
+        KVCounters after = kv_counters(b);
+        size_t hits = after.prefix_hit_tokens - before.prefix_hit_tokens;
+        printf("%-8s %12zu %12.0f %9.2f%%\n", modes[m].name, after.cached_pages,
+               secs * 1e9 / (double) n, prompt ? 100.0 * (double) hits / (double) prompt : 0.0);
+        kv_destroy(b);
+    }
+    free(work);
+    return 0;
+}
@@ -0,0 +1,40 @@
+#ifndef COST_MODEL_H
+#define COST_MODEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// What one engine step (one batched forward pass) has to do.
+typedef struct StepShape {
+    size_t prefill_tokens;  // prompt tokens ingested this step
+    size_t decode_seqs;     // sequences producing one token this step
+    size_t kv_bytes;        // KV bytes attention reads this step
+    size_t swap_bytes;      // KV moved between host and device memory
+} StepShape;
+
+struct CostModel;
+typedef uint64_t (*StepCostFn)(const struct CostModel* model, const StepShape* shape);
+
+// Virtual duration of a step. step_ns == NULL means cost_model_linear_ns.
+// The coefficients are interpreted by step_ns; custom models may ignore them
+// and hang their own state off ctx.
+typedef struct CostModel {
+    StepCostFn step_ns;
+    void*  ctx;
+
+    double step_overhead_ns;      // fixed cost per step (weights, launch)
+    double prefill_ns_per_token;
+    double decode_ns_per_seq;
+    double attn_ns_per_kv_byte;   // memory-bound attention over resident KV
+    double swap_ns_per_byte;      // host <-> device copies of preempted KV
+} CostModel;
+
+// overhead + prefill*tokens + decode*seqs + attn*kv_bytes + swap*swap_bytes
+uint64_t  cost_model_linear_ns(const CostModel* model, const StepShape* shape);
+CostModel cost_model_default(void);
+
+static inline uint64_t cost_model_step_ns(const CostModel* m, const StepShape* s) {
+    return m->step_ns ? m->step_ns(m, s) : cost_model_linear_ns(m, s);
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct SimEvent {
+    uint64_t time_ns;   // virtual time the event fires at
+    uint64_t order;     // insertion order; breaks ties so runs are reproducible
+    int      type;
+    size_t   arg;
+} SimEvent;
+
+// Min-heap of events keyed on (time_ns, order).
+typedef struct EventQueue {
+    SimEvent* heap;
+    size_t size;
+    size_t capacity;
+    uint64_t next_order;
+} EventQueue;
+
+void event_queue_init(EventQueue* q);
+void event_queue_destroy(EventQueue* q);
+
+void event_queue_push(EventQueue* q, uint64_t time_ns, int type, size_t arg);
+// Returns 0 if the queue is empty.
+int  event_queue_pop(EventQueue* q, SimEvent* out);
+
+static inline int event_queue_empty(const EventQueue* q) {
+    return q->size == 0;
+}
+
+#endif
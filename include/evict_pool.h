@@ -0,0 +1,51 @@
+#ifndef EVICT_POOL_H
+#define EVICT_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sim_config.h"
+
+#define EVICT_NOT_POOLED SIZE_MAX
+
+// Bookkeeping embedded in every prefix cache entry (radix node, hash entry,
+// prefix group). An entry sits in the pool while it is idle: the cache holds
+// its pages but no sequence does.
+typedef struct EvictEntry {
+    uint64_t last_used;    // pool clock when it last went idle
+    uint64_t hits;         // times a sequence picked it up from the cache
+    uint64_t cost;         // relative price of rebuilding it (EVICT_COST)
+    uint64_t key;          // eviction order while pooled, lowest first
+    size_t   heap_index;   // EVICT_NOT_POOLED when not pooled
+} EvictEntry;
+
+// Min-heap of idle entries ordered by SimConfig::cache_evict. Not
+// thread-safe: callers serialize (the paged backend's mutex).
+typedef struct EvictPool {
+    EvictEntry** heap;
+    size_t size;
+    size_t capacity;
+    EvictPolicy policy;
+    uint64_t clock;
+    uint64_t inflation;    // EVICT_COST: key of the last entry evicted
+} EvictPool;
+
+void evict_pool_init(EvictPool* p, EvictPolicy policy);
+void evict_pool_destroy(EvictPool* p);
+
+void evict_entry_init(EvictEntry* e, uint64_t cost);
+static inline int evict_entry_pooled(const EvictEntry* e) {
+    return e->heap_index != EVICT_NOT_POOLED;
+}
+
+// A sequence picked e up from the cache; takes it out of the pool.
+void evict_pool_hit(EvictPool* p, EvictEntry* e);
+// e went idle; its key is fixed until it is hit or evicted.
+void evict_pool_push(EvictPool* p, EvictEntry* e);
+// Puts back an entry popped earlier that could not be evicted then, keeping
+// the key it had.
+void evict_pool_requeue(EvictPool* p, EvictEntry* e);
+void evict_pool_remove(EvictPool* p, EvictEntry* e);
+// Takes out the entry to evict next; NULL if the pool is empty.
+EvictEntry* evict_pool_pop(EvictPool* p);
+
+#endif
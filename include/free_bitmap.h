@@ -0,0 +1,40 @@
+#ifndef FREE_BITMAP_H
+#define FREE_BITMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Levels needed for 64^6 bits, far past the 2^32 pages an allocator indexes.
+#define FREE_BITMAP_LEVELS 6
+#define FREE_BITMAP_NONE   SIZE_MAX
+
+// One bit per page, set while it is free, with summary levels above: a bit
+// on level l+1 is set while word i of level l has any bit set, up to a top
+// level of one word. Finding the next free page skips empty regions 64^l
+// pages at a time. Not thread-safe: callers serialize every call.
+typedef struct FreeBitmap {
+    uint64_t* words[FREE_BITMAP_LEVELS];
+    size_t bits[FREE_BITMAP_LEVELS];   // bits on each level
+    size_t levels;
+} FreeBitmap;
+
+// All bits start clear (nothing free).
+void free_bitmap_init(FreeBitmap* b, size_t bits);
+void free_bitmap_destroy(FreeBitmap* b);
+
+void free_bitmap_set(FreeBitmap* b, size_t i);
+void free_bitmap_clear(FreeBitmap* b, size_t i);
+
+static inline int free_bitmap_test(const FreeBitmap* b, size_t i) {
+    return (int) ((b->words[0][i / 64] >> (i % 64)) & 1);
+}
+
+// Lowest set bit at or after i, or FREE_BITMAP_NONE.
+size_t free_bitmap_next(const FreeBitmap* b, size_t i);
+
+// First clear bit at or after i (the end of the run of set bits starting at
+// i), looking no further than limit: returns at most limit, and at most the
+// bitmap's size.
+size_t free_bitmap_run_end(const FreeBitmap* b, size_t i, size_t limit);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef HASH_CACHE_H
+#define HASH_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "page_alloc.h"
+#include "evict_pool.h"
+
+// Prefix cache keyed on chained per-page hashes: page i of a sequence is
+// found under hash_cache_block_hash(hash of page i-1, its token IDs), so a
+// lookup of a prompt is one probe per page. Entries keep the parent hash and
+// the token IDs to reject collisions. The cache holds one reference on each
+// page; entries carry an EvictEntry the caller pools while they are idle.
+//
+// Buckets are fixed at creation and guarded by striped locks, so lookups and
+// inserts from different threads only contend on the same stripe.
+typedef struct HashCache HashCache;
+
+#define HASH_CACHE_ROOT 0   // parent hash of a sequence's first page
+
+HashCache* hash_cache_create(PageAllocator* pa, size_t tokens_per_page, size_t max_pages);
+void       hash_cache_destroy(HashCache* c);   // drops the cache's refs
+
+uint64_t hash_cache_block_hash(uint64_t parent, const uint32_t* block, size_t n);
+
+// The cached entry for block under parent, with a reference on its page
+// taken for the caller when take_ref is set; NULL on a miss.
+EvictEntry* hash_cache_lookup(HashCache* c, uint64_t hash, uint64_t parent,
+                              const uint32_t* block, int take_ref);
+
+// Caches page under hash, taking a reference, and returns the new entry
+// (cost is its rebuild price, see EvictEntry). Returns NULL and leaves page
+// alone if an equal block is already cached.
+EvictEntry* hash_cache_insert(HashCache* c, uint64_t hash, uint64_t parent,
+                              const uint32_t* block, Page* page, uint64_t cost);
+Page* hash_entry_page(const EvictEntry* e);
+
+// Drops e and the cache's reference on its page. Pages cached under e stay
+// until they are removed themselves but can no longer be matched.
+void   hash_cache_remove(HashCache* c, EvictEntry* e);
+size_t hash_cache_pages(HashCache* c);
+
+#endif
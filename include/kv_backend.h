@@ -5,22 +5,73 @@
 #include <stdlib.h>
 #include "sim_config.h"
 #include "workload.h"
+#include "page_alloc.h"
 
 typedef size_t SeqId;
 
+typedef enum KVStatus {
+    KV_OK = 0,
+    KV_ERR_NO_MEMORY,        // out of KV memory; nothing was changed
+} KVStatus;
+
 typedef struct KVStats {
     size_t logical_tokens;
     size_t logical_bytes;
     size_t physical_bytes;
+    size_t capacity_bytes;   // memory budget the backend admits against
 } KVStats;
 
+// Running counters that are cheap enough to sample every step; unlike
+// kv_stats() they never walk sequences or pages.
+typedef struct KVCounters {
+    PageAllocatorStats alloc;   // zero for backends without a page allocator
+
+    size_t preemptions;         // kv_preempt_sequence calls
+    size_t swapped_out_bytes;   // PREEMPT_SWAP: device -> host
+    size_t swapped_in_bytes;    //               host -> device
+    size_t recomputed_tokens;   // PREEMPT_RECOMPUTE: dropped, to be appended again
+
+    size_t prefix_hit_tokens;   // prompt tokens found on resident pages at init
+    size_t prefix_miss_tokens;  // prompt tokens that had to be prefilled
+    size_t cached_pages;        // pages held by the prefix cache right now
+    size_t evicted_pages;       // idle cache pages reclaimed for allocation
+
+    size_t forks;               // kv_fork_sequence calls
+    size_t cow_pages;           // shared pages copied before a write
+    size_t truncated_pages;     // pages released by kv_truncate_sequence
+    size_t slid_pages;          // pages released as the sliding window moved past them
+} KVCounters;
+
 struct KVBackend;
 
 typedef struct KVBackendVTable {
-    SeqId  (*init_sequence)(struct KVBackend* backend, const SequenceWork* work);
-    void   (*append_token)(struct KVBackend* backend, SeqId id);
+    KVStatus (*init_sequence)(struct KVBackend* backend, const SequenceWork* work, SeqId* out);
+    KVStatus (*append_token)(struct KVBackend* backend, SeqId id);
+    // n tokens in one call, e.g. a whole prompt, allocating their pages in
+    // one batch. Stops at the first token that does not fit, like n
+    // append_token calls; *appended (if non-NULL) counts the ones that did.
+    KVStatus (*append_tokens)(struct KVBackend* backend, SeqId id, size_t n, size_t* appended);
     void   (*finish_sequence)(struct KVBackend* backend, SeqId id);
+    // Rolls a running sequence back to its first new_len tokens (no-op if it
+    // is not longer), e.g. dropping rejected speculative drafts.
+    void   (*truncate_sequence)(struct KVBackend* backend, SeqId id, size_t new_len);
+    // Optional: non-zero if the sequence can run to completion without
+    // exhausting memory, counting what admitted sequences may still grow.
+    int    (*can_admit)(struct KVBackend* backend, const SequenceWork* work);
+    // Optional pair: release a running sequence's device memory but keep its
+    // id (see SimConfig::preempt_mode). resume_sequence() takes the memory
+    // back, all or nothing, and sets *recompute to the number of tokens the
+    // caller has to append again before the sequence is whole.
+    void   (*preempt_sequence)(struct KVBackend* backend, SeqId id);
+    KVStatus (*resume_sequence)(struct KVBackend* backend, SeqId id, size_t* recompute);
+    // Optional: a new sequence holding a copy of a running parent's tokens,
+    // for parallel sampling and beam search. Paged backends share the
+    // history until either side appends. work describes the child's tokens
+    // past the fork and bounds its growth; NULL means the parent's.
+    KVStatus (*fork_sequence)(struct KVBackend* backend, SeqId parent, const SequenceWork* work,
+                              SeqId* out);
     KVStats (*stats)(struct KVBackend* backend);
+    void   (*counters)(struct KVBackend* backend, KVCounters* out);   // optional
     void   (*destroy)(struct KVBackend* backend);
 } KVBackendVTable;
 
@@ -30,18 +81,47 @@ typedef struct KVBackend {
 } KVBackend;
 
 // Helper inline wrappers
-static inline SeqId kv_init_sequence(KVBackend* b, const SequenceWork* w) {
-    return b->vtable->init_sequence(b, w);
+static inline KVStatus kv_init_sequence(KVBackend* b, const SequenceWork* w, SeqId* out) {
+    return b->vtable->init_sequence(b, w, out);
+}
+static inline KVStatus kv_append_token(KVBackend* b, SeqId id) {
+    return b->vtable->append_token(b, id);
 }
-static inline void kv_append_token(KVBackend* b, SeqId id) {
-    b->vtable->append_token(b, id);
+static inline KVStatus kv_append_tokens(KVBackend* b, SeqId id, size_t n, size_t* appended) {
+    return b->vtable->append_tokens(b, id, n, appended);
 }
 static inline void kv_finish_sequence(KVBackend* b, SeqId id) {
     b->vtable->finish_sequence(b, id);
 }
+static inline void kv_truncate_sequence(KVBackend* b, SeqId id, size_t new_len) {
+    b->vtable->truncate_sequence(b, id, new_len);
+}
+static inline int kv_can_admit(KVBackend* b, const SequenceWork* w) {
+    return b->vtable->can_admit ? b->vtable->can_admit(b, w) : 1;
+}
+static inline int kv_can_preempt(KVBackend* b) {
+    return b->vtable->preempt_sequence != NULL;
+}
+static inline void kv_preempt_sequence(KVBackend* b, SeqId id) {
+    b->vtable->preempt_sequence(b, id);
+}
+static inline KVStatus kv_resume_sequence(KVBackend* b, SeqId id, size_t* recompute) {
+    return b->vtable->resume_sequence(b, id, recompute);
+}
+static inline int kv_can_fork(KVBackend* b) {
+    return b->vtable->fork_sequence != NULL;
+}
+static inline KVStatus kv_fork_sequence(KVBackend* b, SeqId parent, const SequenceWork* w, SeqId* out) {
+    return b->vtable->fork_sequence(b, parent, w, out);
+}
 static inline KVStats kv_stats(KVBackend* b) {
     return b->vtable->stats(b);
 }
+static inline KVCounters kv_counters(KVBackend* b) {
+    KVCounters c = {0};
+    if (b->vtable->counters) b->vtable->counters(b, &c);
+    return c;
+}
 static inline void kv_destroy(KVBackend* b) {
     if (!b) return;
     b->vtable->destroy(b);
@@ -0,0 +1,30 @@
+#ifndef MEMSTAT_H
+#define MEMSTAT_H
+
+#include <stddef.h>
+
+// What the kernel has actually committed to this process, as opposed to the
+// bytes the backends account for. Only meaningful when the backends write
+// their KV (SimConfig::touch_kv): untouched memory is never committed.
+typedef struct MemStat {
+    size_t rss_bytes;        // resident, excluding hugetlb pages
+    size_t pss_bytes;        // resident, pages shared with other processes split
+    size_t anon_bytes;       // anonymous part of rss_bytes
+    size_t anon_huge_bytes;  // of which transparent huge pages
+    size_t lazyfree_bytes;   // MADV_FREE pages the kernel has not taken yet
+    size_t hugetlb_bytes;    // MAP_HUGETLB pages, not counted in rss_bytes
+    size_t peak_rss_bytes;   // VmHWM: most resident since memstat_reset_peak
+} MemStat;
+
+// Reads /proc/self/smaps_rollup and /proc/self/status. Returns 0, or -1
+// with *out zeroed where they are not available.
+int memstat_read(MemStat* out);
+
+// Just the resident bytes, from /proc/self/statm: cheap enough to sample
+// every step, unlike memstat_read(). Includes hugetlb pages. 0 if unavailable.
+size_t memstat_rss_bytes(void);
+
+// Restarts peak_rss_bytes from the current rss (/proc/self/clear_refs).
+void memstat_reset_peak(void);
+
+#endif
@@ -7,14 +7,73 @@
 typedef struct Page Page;
 typedef struct PageAllocator PageAllocator;
 
+// Maintained on the alloc/free paths; reading them is O(1) and lock-free.
+typedef struct PageAllocatorStats {
+    size_t pages_total;
+    size_t pages_open;     // in arena segments opened so far; pages_total
+                           // unless SimConfig::arena_segment_bytes is set
+    size_t pages_in_use;
+    size_t peak_in_use;
+    size_t allocs;
+    size_t frees;          // pages whose last reference was dropped
+    size_t failed_allocs;
+
+    // SimConfig::reclaim; zero with RECLAIM_NONE
+    size_t committed_free;   // free pages on the shared list still committed
+    size_t reclaimed_pages;  // given back to the kernel
+    size_t reclaim_calls;    // madvise calls; adjacent pages go together
+    size_t reclaim_failures; // madvise calls the kernel refused; those pages stay
+    size_t reclaim_reuses;   // allocations of uncommitted free pages (given back,
+                             // or never used), which fault in again
+} PageAllocatorStats;
+
+// Backing the arena actually got (see SimConfig::arena_backing).
+typedef enum ArenaPages {
+    ARENA_PAGES_BASE = 0,    // base pages, as requested or as the fallback
+    ARENA_PAGES_HUGETLB,     // reserved huge pages (vm.nr_hugepages)
+    ARENA_PAGES_THP,         // advised for transparent huge pages; the kernel
+                             // promotes what it can
+} ArenaPages;
+
 PageAllocator* page_allocator_create(const SimConfig* cfg);
 void           page_allocator_destroy(PageAllocator* pa);
 
-Page*  page_alloc(PageAllocator* pa);
+Page*  page_alloc(PageAllocator* pa);   // NULL when every page is in use
+// Up to n pages into out in one call; returns how many, fewer only when the
+// allocator runs out.
+size_t page_alloc_n(PageAllocator* pa, Page** out, size_t n);
+// page_alloc_n for pages that extend a block table ending in `after` (NULL
+// for a new one). With PAGE_FREELIST_BITMAP the pages right after it come
+// first, then the start of a free run with room to grow; the other modes
+// ignore the hint.
+size_t page_alloc_after(PageAllocator* pa, const Page* after, Page** out, size_t n);
 void   page_inc_ref(PageAllocator* pa, Page* p);
 void   page_dec_ref(PageAllocator* pa, Page* p);
+// page_dec_ref on each of n pages; the ones that go free return to the free
+// list together, under one lock or CAS.
+void   page_free_n(PageAllocator* pa, Page** pages, size_t n);
+unsigned char* page_data(const Page* p);   // page_allocator_page_bytes() bytes
+unsigned       page_ref_count(const Page* p);   // a snapshot; racy unless callers serialize
+
+// Return the calling thread's magazine (SimConfig::page_cache_pages) to the
+// shared free list so other threads can allocate those pages.
+void   page_allocator_drain_cache(PageAllocator* pa);
+
+// Gives the memory of free pages on the shared list back to the kernel
+// (SimConfig::reclaim_advice) until at most keep_pages of them are still
+// committed, longest runs of adjacent pages first. Runs shorter than
+// SimConfig::reclaim_min_run_bytes stay, and nothing is done until more
+// than keep_pages plus one such run are committed, so calling it often is
+// cheap. Pages parked in magazines are left alone. Does nothing with
+// RECLAIM_NONE.
+void   page_allocator_reclaim(PageAllocator* pa, size_t keep_pages);
 
 size_t page_allocator_pages_in_use(PageAllocator* pa);
+size_t page_allocator_free_pages(PageAllocator* pa);
+PageAllocatorStats page_allocator_stats(PageAllocator* pa);
 size_t page_allocator_page_bytes(PageAllocator* pa);
+size_t page_allocator_num_pages(PageAllocator* pa);
+ArenaPages page_allocator_arena_pages(PageAllocator* pa);
+size_t page_allocator_huge_page_bytes(PageAllocator* pa);   // 0 with base pages
 
 #endif
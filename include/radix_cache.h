@@ -0,0 +1,47 @@
+#ifndef RADIX_CACHE_H
+#define RADIX_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "page_alloc.h"
+#include "evict_pool.h"
+
+// Prefix cache over token IDs. Every edge is one full page of tokens, so a
+// node is exactly one cached Page and matches never split an edge. The cache
+// holds one reference on each node's page; only leaves are removed, so a
+// cached page is always reachable from the root.
+//
+// Nodes carry an EvictEntry (cost = depth in pages) that the caller pools
+// while the node is idle. Not thread-safe: callers serialize access (the
+// paged backend's mutex).
+typedef struct RadixCache RadixCache;
+typedef struct RadixNode RadixNode;   // NULL stands for the root
+
+RadixCache* radix_cache_create(PageAllocator* pa, size_t tokens_per_page);
+void        radix_cache_destroy(RadixCache* c);   // drops the cache's refs
+
+// Walks tokens[0 .. num_pages * tokens_per_page) from the root and returns
+// how many leading pages are cached. If hits is non-NULL each matched page
+// gets a reference and its node's entry is stored in hits[i]. *last is the
+// deepest matched node (NULL if none).
+size_t radix_cache_match(RadixCache* c, const uint32_t* tokens, size_t num_pages,
+                         EvictEntry** hits, RadixNode** last);
+
+// Caches page as the child of parent holding the tokens_per_page IDs in
+// block, taking a reference, and sets *adopted to the new node's entry. If
+// that child already exists the page is left alone, *adopted is NULL and the
+// existing node is returned.
+RadixNode* radix_cache_insert(RadixCache* c, RadixNode* parent,
+                              const uint32_t* block, Page* page, EvictEntry** adopted);
+RadixNode*  radix_node_parent(const RadixNode* n);
+EvictEntry* radix_node_entry(RadixNode* n);
+RadixNode*  radix_entry_node(EvictEntry* e);
+Page*       radix_entry_page(const EvictEntry* e);
+
+// Drops a leaf and the cache's reference on its page. Returns 0 and does
+// nothing if e still has children. *parent_leaf is the parent's entry if
+// the parent just became a leaf, NULL otherwise.
+int    radix_cache_remove(RadixCache* c, EvictEntry* e, EvictEntry** parent_leaf);
+size_t radix_cache_pages(const RadixCache* c);
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef SEQ_TABLE_H
+#define SEQ_TABLE_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+// Chunk k holds SEQ_TABLE_FIRST << k entries; 40 chunks never run out.
+#define SEQ_TABLE_FIRST  16
+#define SEQ_TABLE_CHUNKS 40
+
+// Per-sequence state indexed by SeqId. Storage grows by adding chunks that
+// double in size and is never moved, so a pointer to an entry stays valid
+// and lookups need no lock while another thread grows the table. Growth
+// itself is not thread-safe: callers serialize seq_table_reserve().
+typedef struct SeqTable {
+    size_t elem_size;
+    size_t capacity;         // entries in allocated chunks
+    size_t num_chunks;
+    _Atomic(unsigned char*) chunks[SEQ_TABLE_CHUNKS];
+} SeqTable;
+
+void seq_table_init(SeqTable* t, size_t elem_size);
+void seq_table_destroy(SeqTable* t);
+
+// Makes ids [0, n) addressable. New entries are zeroed.
+void seq_table_reserve(SeqTable* t, size_t n);
+
+// id must be below a capacity the caller has seen reserved.
+static inline void* seq_table_at(SeqTable* t, size_t id) {
+    size_t slot = id / SEQ_TABLE_FIRST + 1;
+    size_t k = (size_t) (63 - __builtin_clzll((unsigned long long) slot));
+    size_t base = SEQ_TABLE_FIRST * (((size_t) 1 << k) - 1);
+    unsigned char* chunk = atomic_load_explicit(&t->chunks[k], memory_order_acquire);
+    return chunk + (id - base) * t->elem_size;
+}
+
+#endif
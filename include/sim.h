@@ -3,9 +3,80 @@
 #include "kv_backend.h"
 #include "sim_config.h"
 #include "workload.h"
+#include "memstat.h"
+#include <stdint.h>
+
+typedef struct LatencySummary {
+    double   mean_ns;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t max_ns;
+} LatencySummary;
+
+// All times are virtual (see SimConfig::cost), not wall clock.
+typedef struct SimReport {
+    size_t   steps;
+    uint64_t makespan_ns;         // first arrival -> last completion
+    size_t   completed;
+    size_t   rejected;            // could not fit even in an idle backend
+    size_t   prompt_tokens;
+    size_t   generated_tokens;
+
+    size_t peak_running;
+    double mean_running;          // time-weighted
+    double mean_queue_ns;         // arrival -> admission
+    double mean_tpot_ns;          // per decoded token after the first
+    LatencySummary ttft;          // arrival -> end of prefill step
+    LatencySummary latency;       // arrival -> completion
+
+    KVStats peak;                 // snapshot at peak physical_bytes
+    double mean_logical_bytes;    // time-weighted
+    double mean_physical_bytes;
+
+    KVCounters counters;          // at the end of the run
+
+    // Measured process memory, to hold against peak.physical_bytes when the
+    // backend writes its KV (SimConfig::touch_kv)
+    MemStat mem_start;            // before the first step
+    MemStat mem_end;              // after the last, before the caller destroys
+                                  // the backend; peak_rss_bytes covers the run
+    double mean_rss_bytes;        // SIM_DRIVER_CONTINUOUS: RSS growth since the
+                                  // start, time-weighted like mean_physical_bytes
+
+    // SIM_DRIVER_CONTINUOUS step shape (see SimConfig::prefill_chunk_tokens)
+    LatencySummary decode_step;   // duration of steps that decoded: the gap
+                                  // between two tokens of a running sequence
+    size_t peak_step_allocs;      // most pages allocated in one step
+
+    // Out-of-memory handling (see SimConfig::admission, oom_policy)
+    size_t oom_stalls;            // sequence-steps lost waiting for memory
+    size_t oom_requeues;          // admissions that failed and stayed queued
+    size_t oom_preemptions;       // running sequences evicted and requeued
+    size_t oom_dropped;           // sequences abandoned by drivers that
+                                  // cannot wait (no one ever finishes)
+
+    // SIM_DRIVER_BEAM
+    size_t beam_forks;            // kv_fork_sequence calls that succeeded
+    size_t beam_prunes;           // beams finished because they fell out
+    size_t beam_fork_failures;    // forks refused for lack of memory
+
+    // SIM_DRIVER_SPECULATIVE
+    size_t spec_drafted;          // draft tokens appended
+    size_t spec_accepted;         // drafts kept; the rest were truncated away
+} SimReport;
 
 KVStats run_simulation(KVBackend* backend,
                        const SimConfig* cfg,
                        const SequenceWork* work);
 
+// Same as run_simulation, additionally filling *report (may be NULL).
+// The thread-per-sequence driver only fills report->peak and the token and
+// completion counts; the worker pool driver adds step counts and virtual
+// makespan, and the beam and speculative drivers also the peak and their
+// own counts.
+KVStats run_simulation_report(KVBackend* backend,
+                              const SimConfig* cfg,
+                              const SequenceWork* work,
+                              SimReport* report);
+
 #endif
@@ -3,6 +3,86 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include "cost_model.h"
+
+typedef enum SimDriver {
+    SIM_DRIVER_THREAD_PER_SEQ = 0, // one pthread per SequenceWork
+    SIM_DRIVER_WORKER_POOL,        // fixed pool, one decode token per sequence per step
+    SIM_DRIVER_CONTINUOUS,         // arrivals, admission and completion over time
+    SIM_DRIVER_BEAM,               // worker pool steps, beam_width beams per request
+    SIM_DRIVER_SPECULATIVE,        // worker pool steps, spec_draft_tokens drafts verified per step
+} SimDriver;
+
+// How the continuous driver decides a waiting request may start.
+typedef enum AdmissionPolicy {
+    ADMIT_RESERVE = 0,   // only if its whole lifetime fits (kv_can_admit)
+    ADMIT_OPTIMISTIC,    // if its prompt fits right now; OOM is handled later
+} AdmissionPolicy;
+
+// What the continuous driver does when a running sequence cannot get memory.
+typedef enum OomPolicy {
+    OOM_STALL = 0,       // it sits the step out and retries next step
+    OOM_PREEMPT,         // evict a running sequence (victim_policy), requeue it
+} OomPolicy;
+
+// Which running sequence OOM_PREEMPT evicts.
+typedef enum VictimPolicy {
+    VICTIM_LIFO = 0,         // most recently admitted
+    VICTIM_LOWEST_PRIORITY,  // lowest SequenceWork::priority, then LIFO
+    VICTIM_LONGEST,          // most KV tokens held, then LIFO
+} VictimPolicy;
+
+// How a backend that supports kv_preempt_sequence gives up a victim's pages.
+typedef enum PreemptMode {
+    PREEMPT_RECOMPUTE = 0,   // drop them; the tokens are prefilled again
+    PREEMPT_SWAP,            // copy them to host memory and back on resume
+} PreemptMode;
+
+// How the paged backend finds prompt pages it can share.
+typedef enum PrefixCacheMode {
+    PREFIX_CACHE_GROUPS = 0,   // shared_prompt_id % num_groups, built on first use
+    PREFIX_CACHE_RADIX,        // radix tree over token IDs (workload_token)
+    PREFIX_CACHE_HASH,         // chained per-page hashes in a striped hash table
+} PrefixCacheMode;
+
+// Which idle prefix cache entry goes first when pages run out.
+typedef enum EvictPolicy {
+    EVICT_LRU = 0,       // went idle longest ago
+    EVICT_LFU,           // fewest cache hits
+    EVICT_COST,          // hits x rebuild cost, aged GreedyDual style
+} EvictPolicy;
+
+typedef enum PageFreeList {
+    PAGE_FREELIST_MUTEX = 0,       // Page* stack under one mutex
+    PAGE_FREELIST_LOCKFREE,        // tagged-index Treiber stack (ABA-safe)
+    PAGE_FREELIST_BITMAP,          // free bitmap under one mutex; hands out
+                                   // runs of adjacent pages, no magazines
+} PageFreeList;
+
+// What the page allocator asks the kernel to back its arena with.
+typedef enum ArenaBacking {
+    ARENA_BASE_PAGES = 0,          // plain anonymous mmap
+    ARENA_HUGE_PAGES,              // MAP_HUGETLB (1 GiB, then 2 MiB), else
+                                   // madvise(MADV_HUGEPAGE) on a 2 MiB aligned map
+} ArenaBacking;
+
+// When the page allocator gives the memory of free pages back to the kernel,
+// so RSS follows the pages in use rather than the most ever used.
+typedef enum PageReclaim {
+    RECLAIM_NONE = 0,              // free pages stay committed for reuse
+    RECLAIM_ON_FINISH,             // when a sequence finishes, all but
+                                   // reclaim_keep_pages of them
+    RECLAIM_HIGH_WATER,            // once more than reclaim_high_water are
+                                   // committed, down to half of that
+} PageReclaim;
+
+// How reclaimed pages are given back.
+typedef enum ReclaimAdvice {
+    RECLAIM_DONTNEED = 0,          // MADV_DONTNEED: RSS drops at once; reuse
+                                   // faults in zeroed pages
+    RECLAIM_FREE,                  // MADV_FREE: the kernel takes them under memory
+                                   // pressure; reuse before that costs nothing
+} ReclaimAdvice;
 
 typedef struct SimConfig {
     size_t num_layers;
@@ -10,17 +90,51 @@ typedef struct SimConfig {
     size_t head_dim;
 
     size_t max_context_tokens;   // NEW: fixed max context window (e.g., 2048)
+    size_t sliding_window_tokens; // paged: attend to the last N tokens only, which
+                                  // also lifts max_context_tokens (0 => full attention)
 
     size_t tokens_per_page;
     size_t arena_bytes;
+    PageFreeList freelist;
+    ArenaBacking arena_backing;
+    size_t arena_segment_bytes; // > 0 => only reserve the arena; segments this big
+                                // are committed and described as pages run out
+    PageReclaim reclaim;
+    ReclaimAdvice reclaim_advice;
+    size_t reclaim_high_water;  // RECLAIM_HIGH_WATER: committed free pages allowed
+    size_t reclaim_keep_pages;  // RECLAIM_ON_FINISH: committed free pages kept warm
+    size_t reclaim_min_run_bytes; // shortest run of adjacent free pages worth an
+                                  // madvise (0 => 2 MiB)
+    int touch_kv;              // appends write each token's K/V bytes, so the OS
+                               // commits what the backends hold (0 => bookkeeping only)
+    size_t page_cache_pages;   // per-thread page magazine size (0 => off)
+    PrefixCacheMode prefix_cache;
+    EvictPolicy cache_evict;
 
     size_t num_sequences;
     size_t num_groups;         // how many shared-prefix groups
     size_t max_prompt_extra;   // extra tokens on top of prefix
     size_t min_gen_tokens;
     size_t max_gen_tokens;
+    size_t conversation_turns; // > 1 => later turns resend earlier history
+    size_t beam_width;         // SIM_DRIVER_BEAM: beams kept per request (0 => 1)
+    size_t spec_draft_tokens;  // SIM_DRIVER_SPECULATIVE: drafts per step (0 => plain decode)
+    double spec_accept_rate;   // chance each draft is accepted, given the ones before were
+
+    CostModel cost;            // virtual duration of each engine step
+
+    SimDriver driver;
+    size_t num_workers;        // worker pool size (0 => online cores)
 
-    int    enable_sleep;       // non-zero: simulate compute with usleep
+    double arrival_rate;       // mean request arrivals per virtual second (0 => all at t=0)
+    size_t prefill_chunk_tokens; // SIM_DRIVER_CONTINUOUS: most prompt tokens a sequence
+                                 // ingests per step (0 => the whole prompt at once)
+    size_t step_token_budget;  // SIM_DRIVER_CONTINUOUS: most tokens per step; decodes
+                               // always run and prefill chunks get the rest (0 => no limit)
+    AdmissionPolicy admission;
+    OomPolicy oom_policy;
+    VictimPolicy victim_policy;
+    PreemptMode preempt_mode;
 } SimConfig;
 
 static inline size_t bytes_per_token(const SimConfig* cfg) {
@@ -0,0 +1,23 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <stddef.h>
+
+typedef struct WorkerPool WorkerPool;
+
+// Called with a half-open range [begin, end) of items and the index of the
+// worker running it (0 <= worker < worker_pool_size()).
+typedef void (*WorkerPoolFn)(void* ctx, size_t begin, size_t end, size_t worker);
+
+// num_workers == 0 => one worker per online core
+WorkerPool* worker_pool_create(size_t num_workers);
+void        worker_pool_destroy(WorkerPool* pool);
+
+size_t worker_pool_size(const WorkerPool* pool);
+
+// Runs fn over [0, n) on the pool and returns once every item is done.
+// Items are handed out in chunks, so fn must not assume any ordering.
+void worker_pool_parallel_for(WorkerPool* pool, size_t n,
+                              WorkerPoolFn fn, void* ctx);
+
+#endif
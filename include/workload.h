@@ -2,17 +2,27 @@
 #define WORKLOAD_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include "sim_config.h"
 
 typedef struct {
     size_t prompt_tokens;        // includes any shared prefix
     size_t gen_tokens;
-    size_t shared_prompt_tokens; // shareable prefix (must be page-aligned)
+    size_t shared_prompt_tokens; // shareable prefix (may end mid-page)
     int    shared_prompt_id;     // -1 => no sharing
+    uint64_t arrival_ns;         // virtual time the request arrives at
+    int    priority;             // higher is more important (0..3)
+    uint64_t stream_id;          // token source past the shared prompt; turns
+                                 // of one conversation share it
 } SequenceWork;
 
 // Generate an array of SequenceWork of length num_sequences
 // Caller owns returned pointer; free() when done.
 SequenceWork* generate_workload(const SimConfig* cfg);
 
+// Token ID at position pos of w's prompt or generation. Deterministic, so
+// requests with the same system prompt or conversation history agree on
+// their common prefix.
+uint32_t workload_token(const SequenceWork* w, size_t pos);
+
 #endif
@@ -0,0 +1,25 @@
+#include "cost_model.h"
+
+uint64_t cost_model_linear_ns(const CostModel* m, const StepShape* s) {
+    double ns = m->step_overhead_ns
+              + m->prefill_ns_per_token * (double) s->prefill_tokens
+              + m->decode_ns_per_seq    * (double) s->decode_seqs
+              + m->attn_ns_per_kv_byte  * (double) s->kv_bytes
+              + m->swap_ns_per_byte     * (double) s->swap_bytes;
+    return ns > 0.0 ? (uint64_t) ns : 0;
+}
+
+// Loosely a mid-sized model on one accelerator: a weight-bound step floor,
+// compute-bound prefill, ~2 TB/s for streaming KV through attention and
+// ~25 GB/s for swapping KV over PCIe.
+CostModel cost_model_default(void) {
+    CostModel m;
+    m.step_ns              = cost_model_linear_ns;
+    m.ctx                  = NULL;
+    m.step_overhead_ns     = 5e6;
+    m.prefill_ns_per_token = 50e3;
+    m.decode_ns_per_seq    = 20e3;
+    m.attn_ns_per_kv_byte  = 5e-4;
+    m.swap_ns_per_byte     = 4e-2;
+    return m;
+}
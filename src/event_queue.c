@@ -0,0 +1,59 @@
+#include <stdlib.h>
+#include "event_queue.h"
+
+static int event_before(const SimEvent* a, const SimEvent* b) {
+    if (a->time_ns != b->time_ns) return a->time_ns < b->time_ns;
+    return a->order < b->order;
+}
+
+void event_queue_init(EventQueue* q) {
+    q->heap = NULL;
+    q->size = 0;
+    q->capacity = 0;
+    q->next_order = 0;
+}
+
+void event_queue_destroy(EventQueue* q) {
+    free(q->heap);
+    event_queue_init(q);
+}
+
+void event_queue_push(EventQueue* q, uint64_t time_ns, int type, size_t arg) {
+    if (q->size == q->capacity) {
+        size_t new_cap = q->capacity == 0 ? 64 : q->capacity * 2;
+        SimEvent* nh = (SimEvent*) realloc(q->heap, new_cap * sizeof(SimEvent));
+        if (!nh) abort();
+        q->heap = nh;
+        q->capacity = new_cap;
+    }
+
+    SimEvent ev = { time_ns, q->next_order++, type, arg };
+    size_t i = q->size++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!event_before(&ev, &q->heap[parent])) break;
+        q->heap[i] = q->heap[parent];
+        i = parent;
+    }
+    q->heap[i] = ev;
+}
+
+int event_queue_pop(EventQueue* q, SimEvent* out) {
+    if (q->size == 0) return 0;
+    *out = q->heap[0];
+
+    SimEvent last = q->heap[--q->size];
+    size_t i = 0;
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= q->size) break;
+        if (child + 1 < q->size && event_before(&q->heap[child + 1], &q->heap[child])) {
+            child++;
+        }
+        if (!event_before(&q->heap[child], &last)) break;
+        q->heap[i] = q->heap[child];
+        i = child;
+    }
+    if (q->size > 0) q->heap[i] = last;
+    return 1;
+}
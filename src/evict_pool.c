@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include "evict_pool.h"
+
+// Ties break on last_used so every policy degrades to LRU.
+static int entry_before(const EvictEntry* a, const EvictEntry* b) {
+    if (a->key != b->key) return a->key < b->key;
+    return a->last_used < b->last_used;
+}
+
+static void heap_set(EvictPool* p, size_t i, EvictEntry* e) {
+    p->heap[i] = e;
+    e->heap_index = i;
+}
+
+static void sift_up(EvictPool* p, size_t i) {
+    EvictEntry* e = p->heap[i];
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!entry_before(e, p->heap[parent])) break;
+        heap_set(p, i, p->heap[parent]);
+        i = parent;
+    }
+    heap_set(p, i, e);
+}
+
+static void sift_down(EvictPool* p, size_t i) {
+    EvictEntry* e = p->heap[i];
+    for (;;) {
+        size_t l = 2 * i + 1;
+        if (l >= p->size) break;
+        size_t r = l + 1;
+        size_t c = (r < p->size && entry_before(p->heap[r], p->heap[l])) ? r : l;
+        if (!entry_before(p->heap[c], e)) break;
+        heap_set(p, i, p->heap[c]);
+        i = c;
+    }
+    heap_set(p, i, e);
+}
+
+static void heap_insert(EvictPool* p, EvictEntry* e) {
+    if (p->size == p->capacity) {
+        size_t new_cap = p->capacity == 0 ? 64 : p->capacity * 2;
+        EvictEntry** nh = (EvictEntry**) realloc(p->heap, new_cap * sizeof(EvictEntry*));
+        if (!nh) abort();
+        p->heap = nh;
+        p->capacity = new_cap;
+    }
+    heap_set(p, p->size++, e);
+    sift_up(p, e->heap_index);
+}
+
+void evict_pool_init(EvictPool* p, EvictPolicy policy) {
+    p->heap = NULL;
+    p->size = 0;
+    p->capacity = 0;
+    p->policy = policy;
+    p->clock = 0;
+    p->inflation = 0;
+}
+
+void evict_pool_destroy(EvictPool* p) {
+    free(p->heap);
+    evict_pool_init(p, p->policy);
+}
+
+void evict_entry_init(EvictEntry* e, uint64_t cost) {
+    e->last_used = 0;
+    e->hits = 0;
+    e->cost = cost;
+    e->key = 0;
+    e->heap_index = EVICT_NOT_POOLED;
+}
+
+void evict_pool_hit(EvictPool* p, EvictEntry* e) {
+    e->hits++;
+    if (evict_entry_pooled(e)) evict_pool_remove(p, e);
+}
+
+void evict_pool_push(EvictPool* p, EvictEntry* e) {
+    if (evict_entry_pooled(e)) return;
+    e->last_used = ++p->clock;
+    switch (p->policy) {
+    case EVICT_LFU:
+        e->key = e->hits;
+        break;
+    case EVICT_COST:
+        // GreedyDual-Size-Frequency with unit size: entries that are hit
+        // often or are expensive to rebuild outlive the inflation floor.
+        e->key = p->inflation + (e->hits + 1) * e->cost;
+        break;
+    case EVICT_LRU:
+    default:
+        e->key = 0;
+        break;
+    }
+    heap_insert(p, e);
+}
+
+void evict_pool_requeue(EvictPool* p, EvictEntry* e) {
+    if (!evict_entry_pooled(e)) heap_insert(p, e);
+}
+
+void evict_pool_remove(EvictPool* p, EvictEntry* e) {
+    size_t i = e->heap_index;
+    if (i == EVICT_NOT_POOLED) return;
+    e->heap_index = EVICT_NOT_POOLED;
+    EvictEntry* last = p->heap[--p->size];
+    if (i == p->size) return;
+    heap_set(p, i, last);
+    if (i > 0 && entry_before(last, p->heap[(i - 1) / 2])) sift_up(p, i);
+    else sift_down(p, i);
+}
+
+EvictEntry* evict_pool_pop(EvictPool* p) {
+    if (p->size == 0) return NULL;
+    EvictEntry* e = p->heap[0];
+    evict_pool_remove(p, e);
+    if (p->policy == EVICT_COST) p->inflation = e->key;
+    return e;
+}
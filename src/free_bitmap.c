@@ -0,0 +1,70 @@
+#include <stdlib.h>
+#include "free_bitmap.h"
+
+void free_bitmap_init(FreeBitmap* b, size_t bits) {
+    b->levels = 0;
+    do {
+        if (b->levels == FREE_BITMAP_LEVELS) abort();
+        size_t nwords = (bits + 63) / 64;
+        b->bits[b->levels] = bits;
+        b->words[b->levels] = (uint64_t*) calloc(nwords ? nwords : 1, sizeof(uint64_t));
+        if (!b->words[b->levels]) abort();
+        b->levels++;
+        bits = nwords;
+    } while (bits > 1);
+}
+
+void free_bitmap_destroy(FreeBitmap* b) {
+    for (size_t l = 0; l < b->levels; ++l) free(b->words[l]);
+    b->levels = 0;
+}
+
+// A word going from empty to non-empty, or back, flips its summary bit.
+void free_bitmap_set(FreeBitmap* b, size_t i) {
+    for (size_t l = 0; l < b->levels; ++l) {
+        uint64_t* w = &b->words[l][i / 64];
+        int was_empty = *w == 0;
+        *w |= (uint64_t) 1 << (i % 64);
+        if (!was_empty) return;
+        i /= 64;
+    }
+}
+
+void free_bitmap_clear(FreeBitmap* b, size_t i) {
+    for (size_t l = 0; l < b->levels; ++l) {
+        uint64_t* w = &b->words[l][i / 64];
+        *w &= ~((uint64_t) 1 << (i % 64));
+        if (*w != 0) return;
+        i /= 64;
+    }
+}
+
+// The word holding i is checked first; past it, the level above names the
+// next word with anything set.
+static size_t next_on_level(const FreeBitmap* b, size_t l, size_t i) {
+    if (i >= b->bits[l]) return FREE_BITMAP_NONE;
+    size_t w = i / 64;
+    uint64_t word = b->words[l][w] & (~(uint64_t) 0 << (i % 64));
+    if (word) return w * 64 + (size_t) __builtin_ctzll(word);
+    if (l + 1 == b->levels) return FREE_BITMAP_NONE;
+    w = next_on_level(b, l + 1, w + 1);
+    if (w == FREE_BITMAP_NONE) return FREE_BITMAP_NONE;
+    return w * 64 + (size_t) __builtin_ctzll(b->words[l][w]);
+}
+
+size_t free_bitmap_next(const FreeBitmap* b, size_t i) {
+    return next_on_level(b, 0, i);
+}
+
+size_t free_bitmap_run_end(const FreeBitmap* b, size_t i, size_t limit) {
+    size_t n = limit < b->bits[0] ? limit : b->bits[0];
+    while (i < n) {
+        uint64_t clear = ~b->words[0][i / 64] & (~(uint64_t) 0 << (i % 64));
+        if (clear) {
+            size_t end = i / 64 * 64 + (size_t) __builtin_ctzll(clear);
+            return end < n ? end : n;
+        }
+        i = (i / 64 + 1) * 64;
+    }
+    return n;
+}
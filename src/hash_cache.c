@@ -0,0 +1,157 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "hash_cache.h"
+
+#define HASH_CACHE_STRIPES 64
+
+typedef struct HashEntry {
+    EvictEntry entry;        // first, so entries convert back
+    struct HashEntry* next;
+    uint64_t hash;
+    uint64_t parent;
+    Page* page;
+    uint32_t tokens[];       // tokens_per_page IDs
+} HashEntry;
+
+struct HashCache {
+    PageAllocator* alloc;
+    size_t tokens_per_page;
+    HashEntry** buckets;
+    size_t mask;             // num buckets - 1
+    pthread_mutex_t stripes[HASH_CACHE_STRIPES];
+    atomic_size_t num_entries;
+};
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+uint64_t hash_cache_block_hash(uint64_t parent, const uint32_t* block, size_t n) {
+    uint64_t h = parent ^ 0x9e3779b97f4a7c15ull;
+    for (size_t i = 0; i < n; ++i) {
+        h = (h ^ block[i]) * 0x100000001b3ull;
+    }
+    h = mix64(h);
+    return h == HASH_CACHE_ROOT ? 1 : h;
+}
+
+static pthread_mutex_t* stripe_of(HashCache* c, size_t bucket) {
+    return &c->stripes[bucket % HASH_CACHE_STRIPES];
+}
+
+static int entry_matches(const HashCache* c, const HashEntry* e, uint64_t hash,
+                         uint64_t parent, const uint32_t* block) {
+    return e->hash == hash && e->parent == parent &&
+           memcmp(e->tokens, block, c->tokens_per_page * sizeof(uint32_t)) == 0;
+}
+
+HashCache* hash_cache_create(PageAllocator* pa, size_t tokens_per_page, size_t max_pages) {
+    HashCache* c = (HashCache*) calloc(1, sizeof(HashCache));
+    if (!c) abort();
+    size_t nb = 64;
+    while (nb < max_pages) nb *= 2;
+    c->buckets = (HashEntry**) calloc(nb, sizeof(HashEntry*));
+    if (!c->buckets) abort();
+    c->mask = nb - 1;
+    c->alloc = pa;
+    c->tokens_per_page = tokens_per_page;
+    for (size_t i = 0; i < HASH_CACHE_STRIPES; ++i) {
+        pthread_mutex_init(&c->stripes[i], NULL);
+    }
+    atomic_init(&c->num_entries, 0);
+    return c;
+}
+
+void hash_cache_destroy(HashCache* c) {
+    if (!c) return;
+    for (size_t b = 0; b <= c->mask; ++b) {
+        HashEntry* e = c->buckets[b];
+        while (e) {
+            HashEntry* next = e->next;
+            page_dec_ref(c->alloc, e->page);
+            free(e);
+            e = next;
+        }
+    }
+    for (size_t i = 0; i < HASH_CACHE_STRIPES; ++i) {
+        pthread_mutex_destroy(&c->stripes[i]);
+    }
+    free(c->buckets);
+    free(c);
+}
+
+EvictEntry* hash_cache_lookup(HashCache* c, uint64_t hash, uint64_t parent,
+                              const uint32_t* block, int take_ref) {
+    size_t b = hash & c->mask;
+    pthread_mutex_t* lock = stripe_of(c, b);
+    HashEntry* found = NULL;
+    pthread_mutex_lock(lock);
+    for (HashEntry* e = c->buckets[b]; e; e = e->next) {
+        if (entry_matches(c, e, hash, parent, block)) {
+            found = e;
+            if (take_ref) page_inc_ref(c->alloc, e->page);
+            break;
+        }
+    }
+    pthread_mutex_unlock(lock);
+    return found ? &found->entry : NULL;
+}
+
+EvictEntry* hash_cache_insert(HashCache* c, uint64_t hash, uint64_t parent,
+                              const uint32_t* block, Page* page, uint64_t cost) {
+    size_t tpp = c->tokens_per_page;
+    size_t b = hash & c->mask;
+    pthread_mutex_t* lock = stripe_of(c, b);
+    pthread_mutex_lock(lock);
+    for (HashEntry* e = c->buckets[b]; e; e = e->next) {
+        if (entry_matches(c, e, hash, parent, block)) {
+            pthread_mutex_unlock(lock);
+            return NULL;
+        }
+    }
+    HashEntry* e = (HashEntry*) malloc(sizeof(HashEntry) + tpp * sizeof(uint32_t));
+    if (!e) abort();
+    evict_entry_init(&e->entry, cost);
+    e->hash = hash;
+    e->parent = parent;
+    e->page = page;
+    memcpy(e->tokens, block, tpp * sizeof(uint32_t));
+    page_inc_ref(c->alloc, page);
+    e->next = c->buckets[b];
+    c->buckets[b] = e;
+    pthread_mutex_unlock(lock);
+    atomic_fetch_add_explicit(&c->num_entries, 1, memory_order_relaxed);
+    return &e->entry;
+}
+
+Page* hash_entry_page(const EvictEntry* e) {
+    return ((const HashEntry*) e)->page;
+}
+
+void hash_cache_remove(HashCache* c, EvictEntry* entry) {
+    HashEntry* victim = (HashEntry*) entry;
+    size_t b = victim->hash & c->mask;
+    pthread_mutex_t* lock = stripe_of(c, b);
+    pthread_mutex_lock(lock);
+    for (HashEntry** link = &c->buckets[b]; *link; link = &(*link)->next) {
+        if (*link == victim) {
+            *link = victim->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(lock);
+    page_dec_ref(c->alloc, victim->page);
+    free(victim);
+    atomic_fetch_sub_explicit(&c->num_entries, 1, memory_order_relaxed);
+}
+
+size_t hash_cache_pages(HashCache* c) {
+    return atomic_load_explicit(&c->num_entries, memory_order_relaxed);
+}
@@ -1,5 +1,7 @@
+#define _XOPEN_SOURCE 700   // clock_gettime
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include "sim_config.h"
 #include "workload.h"
@@ -23,10 +25,481 @@ static void print_stats(const char* name, const KVStats* st) {
     }
 }
 
-int main(void) {
+static void print_latency(const char* name, const LatencySummary* l) {
+    printf("  %-16s = mean %.1f ms, p50 %.1f ms, p99 %.1f ms\n", name,
+           l->mean_ns / 1e6, (double) l->p50_ns / 1e6, (double) l->p99_ns / 1e6);
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static void print_report(const char* name, const SimReport* r) {
+    double secs = (double) r->makespan_ns / 1e9;
+    printf("%s:\n", name);
+    printf("  steps            = %zu over %.1f s virtual\n", r->steps, secs);
+    printf("  completed        = %zu (rejected %zu)\n", r->completed, r->rejected);
+    printf("  throughput       = %.1f tokens/s\n",
+           secs > 0.0 ? (double) r->generated_tokens / secs : 0.0);
+    printf("  running          = mean %.1f, peak %zu\n", r->mean_running, r->peak_running);
+    printf("  queue            = mean %.1f ms\n", r->mean_queue_ns / 1e6);
+    print_latency("ttft", &r->ttft);
+    printf("  tpot             = mean %.2f ms\n", r->mean_tpot_ns / 1e6);
+    print_latency("latency", &r->latency);
+    printf("  mean occupancy   = %.2f%% of %zu bytes (logical %.0f, physical %.0f)\n",
+           r->peak.capacity_bytes ? 100.0 * r->mean_physical_bytes / (double) r->peak.capacity_bytes : 0.0,
+           r->peak.capacity_bytes, r->mean_logical_bytes, r->mean_physical_bytes);
+    printf("  peak physical    = %zu\n", r->peak.physical_bytes);
+
+    const PageAllocatorStats* a = &r->counters.alloc;
+    if (a->pages_total > 0) {
+        printf("  pages            = peak %zu of %zu, %zu allocs, %zu frees, %zu failed\n",
+               a->peak_in_use, a->pages_total, a->allocs, a->frees, a->failed_allocs);
+    }
+    if (r->oom_stalls || r->oom_requeues || r->oom_preemptions || r->oom_dropped) {
+        printf("  out of memory    = %zu stalls, %zu requeues, %zu preemptions, %zu dropped\n",
+               r->oom_stalls, r->oom_requeues, r->oom_preemptions, r->oom_dropped);
+    }
+    const KVCounters* c = &r->counters;
+    if (c->prefix_hit_tokens > 0) {
+        size_t looked_up = c->prefix_hit_tokens + c->prefix_miss_tokens;
+        printf("  prefix hits      = %zu of %zu prompt tokens (%.2f%%), %zu cached pages, %zu evicted\n",
+               c->prefix_hit_tokens, looked_up,
+               looked_up ? 100.0 * (double) c->prefix_hit_tokens / (double) looked_up : 0.0,
+               c->cached_pages, c->evicted_pages);
+    }
+    if (c->forks > 0 || c->cow_pages > 0) {
+        printf("  forked           = %zu sequences, %zu pages copied on write\n",
+               c->forks, c->cow_pages);
+    }
+    if (c->preemptions > 0) {
+        printf("  preempted        = %zu times, swapped out %zu / in %zu bytes, %zu tokens recomputed\n",
+               c->preemptions, c->swapped_out_bytes, c->swapped_in_bytes, c->recomputed_tokens);
+    }
+}
+
+// Steady-state serving: requests arrive over time and release their KV on
+// completion, so occupancy and throughput are averaged over the run.
+static void run_continuous_scenario(SimConfig cfg) {
+    cfg.driver         = SIM_DRIVER_CONTINUOUS;
+    cfg.num_sequences  = 2048;
+    cfg.arrival_rate   = 10.0;         // requests per virtual second
+
+    SequenceWork* work = generate_workload(&cfg);
+    SimReport rep;
+
+    KVBackend* mono = create_monolithic_backend(&cfg);
+    run_simulation_report(mono, &cfg, work, &rep);
+    print_report("Monolithic (continuous)", &rep);
+    kv_destroy(mono);
+
+    KVBackend* paged = create_paged_backend(&cfg);
+    run_simulation_report(paged, &cfg, work, &rep);
+    print_report("Paged+Prefix (continuous)", &rep);
+    kv_destroy(paged);
+
+    // Same load on a quarter-size arena. Reserving admission queues requests
+    // behind worst-case growth; optimistic admission runs more of them and
+    // has to stall or preempt when pages actually run out.
+    static const struct {
+        const char* name;
+        AdmissionPolicy admission;
+        OomPolicy oom_policy;
+        PreemptMode preempt_mode;
+    } tight[] = {
+        { "Paged+Prefix (continuous, 512M, reserve)",
+          ADMIT_RESERVE,    OOM_STALL,   PREEMPT_RECOMPUTE },
+        { "Paged+Prefix (continuous, 512M, optimistic+stall)",
+          ADMIT_OPTIMISTIC, OOM_STALL,   PREEMPT_RECOMPUTE },
+        { "Paged+Prefix (continuous, 512M, optimistic+preempt/recompute)",
+          ADMIT_OPTIMISTIC, OOM_PREEMPT, PREEMPT_RECOMPUTE },
+        { "Paged+Prefix (continuous, 512M, optimistic+preempt/swap)",
+          ADMIT_OPTIMISTIC, OOM_PREEMPT, PREEMPT_SWAP },
+    };
+    cfg.arena_bytes = (size_t) 512 << 20;
+    for (size_t i = 0; i < sizeof(tight) / sizeof(tight[0]); ++i) {
+        cfg.admission    = tight[i].admission;
+        cfg.oom_policy   = tight[i].oom_policy;
+        cfg.preempt_mode = tight[i].preempt_mode;
+        paged = create_paged_backend(&cfg);
+        run_simulation_report(paged, &cfg, work, &rep);
+        print_report(tight[i].name, &rep);
+        kv_destroy(paged);
+    }
+
+    free(work);
+}
+
+// Wall time is what the backend spent forking and freeing, so it is the one
+// report where host time matters.
+static void print_beam_report(const char* name, const SimReport* r, double wall) {
+    const KVCounters* c = &r->counters;
+    const PageAllocatorStats* a = &c->alloc;
+    printf("%s:\n", name);
+    printf("  steps            = %zu over %.1f s virtual\n", r->steps, (double) r->makespan_ns / 1e9);
+    printf("  completed        = %zu (dropped %zu), %zu tokens over all beams\n",
+           r->completed, r->oom_dropped, r->generated_tokens);
+    printf("  beams            = peak %zu, %zu forks, %zu pruned, %zu forks failed\n",
+           r->peak_running, r->beam_forks, r->beam_prunes, r->beam_fork_failures);
+    printf("  peak physical    = %zu (logical %zu)\n", r->peak.physical_bytes, r->peak.logical_bytes);
+    if (a->pages_total > 0) {
+        printf("  pages            = peak %zu of %zu, %zu allocs, %zu frees, %zu copied on write\n",
+               a->peak_in_use, a->pages_total, a->allocs, a->frees, c->cow_pages);
+    }
+    printf("  wall             = %.3f s, %.0f forks/s, %.2f M page ops/s\n", wall,
+           wall > 0.0 ? (double) r->beam_forks / wall : 0.0,
+           wall > 0.0 ? (double) (a->allocs + a->frees) / wall / 1e6 : 0.0);
+}
+
+// Beam search: every step forks the winning beams and frees the losers. The
+// monolithic backend copies a whole window per fork and runs out of room;
+// the paged backend shares the history and copies at most the last page.
+static void run_beam_scenario(SimConfig cfg) {
+    cfg.driver         = SIM_DRIVER_BEAM;
+    cfg.num_sequences  = 24;           // 96 windows at width 4, 192 at 8
+    cfg.min_gen_tokens = 32;
+    cfg.max_gen_tokens = 128;
+
+    SequenceWork* work = generate_workload(&cfg);
+    SimReport rep;
+
+    static const size_t widths[] = { 4, 8 };
+    for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); ++i) {
+        char name[64];
+        cfg.beam_width = widths[i];
+
+        KVBackend* mono = create_monolithic_backend(&cfg);
+        double t0 = now_sec();
+        run_simulation_report(mono, &cfg, work, &rep);
+        snprintf(name, sizeof(name), "Monolithic (beam %zu)", widths[i]);
+        print_beam_report(name, &rep, now_sec() - t0);
+        kv_destroy(mono);
+
+        KVBackend* paged = create_paged_backend(&cfg);
+        t0 = now_sec();
+        run_simulation_report(paged, &cfg, work, &rep);
+        snprintf(name, sizeof(name), "Paged+Prefix (beam %zu)", widths[i]);
+        print_beam_report(name, &rep, now_sec() - t0);
+        kv_destroy(paged);
+    }
+    free(work);
+}
+
+static void print_spec_report(const char* name, const SimReport* r, double wall) {
+    const KVCounters* c = &r->counters;
+    const PageAllocatorStats* a = &c->alloc;
+    double secs = (double) r->makespan_ns / 1e9;
+    printf("%s:\n", name);
+    printf("  steps            = %zu over %.1f s virtual, %.1f tokens/s\n", r->steps, secs,
+           secs > 0.0 ? (double) r->generated_tokens / secs : 0.0);
+    printf("  completed        = %zu (dropped %zu)\n", r->completed, r->oom_dropped);
+    printf("  drafts           = %zu, %zu accepted (%.1f%%)\n", r->spec_drafted, r->spec_accepted,
+           r->spec_drafted ? 100.0 * (double) r->spec_accepted / (double) r->spec_drafted : 0.0);
+    printf("  peak physical    = %zu (logical %zu)\n", r->peak.physical_bytes, r->peak.logical_bytes);
+    printf("  pages            = peak %zu of %zu, %zu allocs, %zu frees, %zu rolled back\n",
+           a->peak_in_use, a->pages_total, a->allocs, a->frees, c->truncated_pages);
+    printf("  wall             = %.3f s, %.2f M page ops/s\n", wall,
+           wall > 0.0 ? (double) (a->allocs + a->frees) / wall / 1e6 : 0.0);
+}
+
+// Speculative decoding: k drafts per step, the rejected ones rolled back.
+// Rollbacks across a page boundary free the page the next step allocates
+// again, so churn grows with k while peak memory barely moves.
+static void run_spec_scenario(SimConfig cfg) {
+    cfg.driver           = SIM_DRIVER_SPECULATIVE;
+    cfg.spec_accept_rate = 0.7;
+
+    SequenceWork* work = generate_workload(&cfg);
+    SimReport rep;
+
+    static const size_t drafts[] = { 0, 4, 6, 8 };
+    for (size_t i = 0; i < sizeof(drafts) / sizeof(drafts[0]); ++i) {
+        char name[64];
+        cfg.spec_draft_tokens = drafts[i];
+        KVBackend* paged = create_paged_backend(&cfg);
+        double t0 = now_sec();
+        run_simulation_report(paged, &cfg, work, &rep);
+        snprintf(name, sizeof(name), "Paged+Prefix (k=%zu, accept %.2f)", drafts[i], cfg.spec_accept_rate);
+        print_spec_report(name, &rep, now_sec() - t0);
+        kv_destroy(paged);
+    }
+    free(work);
+}
+
+static void print_window_report(const char* name, const SimReport* r, size_t page_bytes) {
+    const KVCounters* c = &r->counters;
+    const PageAllocatorStats* a = &c->alloc;
+    double secs = (double) r->makespan_ns / 1e9;
+    double pages = r->mean_physical_bytes / (double) page_bytes;
+    printf("%s:\n", name);
+    printf("  steps            = %zu over %.1f s virtual, %.1f tokens/s\n", r->steps, secs,
+           secs > 0.0 ? (double) r->generated_tokens / secs : 0.0);
+    printf("  completed        = %zu (rejected %zu), running mean %.1f, peak %zu\n",
+           r->completed, r->rejected, r->mean_running, r->peak_running);
+    printf("  pages/sequence   = %.1f steady state (%.0f pages over %.1f running)\n",
+           r->mean_running > 0.0 ? pages / r->mean_running : 0.0, pages, r->mean_running);
+    printf("  pages            = peak %zu of %zu, %zu allocs, %zu slid out of the window\n",
+           a->peak_in_use, a->pages_total, a->allocs, c->slid_pages);
+}
+
+// Long generations on a sliding-window model: with full attention a
+// sequence's pages grow with its length, with a window they level off at
+// the window, so many more sequences fit the arena.
+static void run_window_scenario(SimConfig cfg) {
+    cfg.driver             = SIM_DRIVER_CONTINUOUS;
+    cfg.max_context_tokens = 32768;
+    cfg.num_sequences      = 256;
+    cfg.num_groups         = 0;
+    cfg.max_prompt_extra   = 512;
+    cfg.min_gen_tokens     = 8192;
+    cfg.max_gen_tokens     = 16384;
+    cfg.arrival_rate       = 2.0;
+    size_t page_bytes = cfg.tokens_per_page * bytes_per_token(&cfg);
+
+    SequenceWork* work = generate_workload(&cfg);
+    SimReport rep;
+
+    static const size_t windows[] = { 0, 4096, 1024 };
+    for (size_t i = 0; i < sizeof(windows) / sizeof(windows[0]); ++i) {
+        char name[64];
+        cfg.sliding_window_tokens = windows[i];
+        KVBackend* paged = create_paged_backend(&cfg);
+        run_simulation_report(paged, &cfg, work, &rep);
+        if (windows[i] == 0) snprintf(name, sizeof(name), "Paged (full attention)");
+        else snprintf(name, sizeof(name), "Paged (window %zu)", windows[i]);
+        print_window_report(name, &rep, page_bytes);
+        kv_destroy(paged);
+    }
+    free(work);
+}
+
+static void print_chunked_report(const char* name, const SimReport* r) {
+    const PageAllocatorStats* a = &r->counters.alloc;
+    double secs = (double) r->makespan_ns / 1e9;
+    printf("%s:\n", name);
+    printf("  steps            = %zu over %.1f s virtual, %.1f tokens/s\n", r->steps, secs,
+           secs > 0.0 ? (double) r->generated_tokens / secs : 0.0);
+    printf("  completed        = %zu (rejected %zu), running mean %.1f\n",
+           r->completed, r->rejected, r->mean_running);
+    print_latency("ttft", &r->ttft);
+    printf("  tpot             = mean %.2f ms\n", r->mean_tpot_ns / 1e6);
+    printf("  decode step      = mean %.1f ms, p99 %.1f ms, max %.1f ms\n",
+           r->decode_step.mean_ns / 1e6, (double) r->decode_step.p99_ns / 1e6,
+           (double) r->decode_step.max_ns / 1e6);
+    printf("  pages per step   = mean %.1f, peak %zu\n",
+           r->steps ? (double) a->allocs / (double) r->steps : 0.0, r->peak_step_allocs);
+}
+
+// Long prompts arriving while others decode. Ingesting a prompt in one step
+// stalls every running sequence behind it; chunked prefill spreads it over
+// several steps under a token budget, trading time to first token for
+// steadier decode steps and smaller bursts of page allocations.
+static void run_chunked_scenario(SimConfig cfg) {
+    cfg.driver             = SIM_DRIVER_CONTINUOUS;
+    cfg.max_context_tokens = 8192;
+    cfg.num_sequences      = 1024;
+    cfg.num_groups         = 0;
+    cfg.max_prompt_extra   = 6144;
+    cfg.min_gen_tokens     = 128;
+    cfg.max_gen_tokens     = 512;
+    cfg.arrival_rate       = 4.0;
+
+    SequenceWork* work = generate_workload(&cfg);
+    SimReport rep;
+
+    static const struct {
+        size_t chunk;
+        size_t budget;
+    } plans[] = {
+        { 0,    0 },
+        { 2048, 2048 },
+        { 512,  1024 },
+        { 128,  512 },
+    };
+    for (size_t i = 0; i < sizeof(plans) / sizeof(plans[0]); ++i) {
+        char name[64];
+        cfg.prefill_chunk_tokens = plans[i].chunk;
+        cfg.step_token_budget    = plans[i].budget;
+        KVBackend* paged = create_paged_backend(&cfg);
+        run_simulation_report(paged, &cfg, work, &rep);
+        if (plans[i].chunk == 0) snprintf(name, sizeof(name), "Paged (whole prompts)");
+        else snprintf(name, sizeof(name), "Paged (chunk %zu, budget %zu)", plans[i].chunk, plans[i].budget);
+        print_chunked_report(name, &rep);
+        kv_destroy(paged);
+    }
+    free(work);
+}
+
+// Change in measured memory over a run, in MiB; negative if it shrank.
+static double mib_delta(size_t before, size_t after) {
+    return ((double) after - (double) before) / (double) (1 << 20);
+}
+
+static void print_touch_report(const char* name, const SimReport* r, double wall) {
+    const MemStat* a = &r->mem_start;
+    const MemStat* b = &r->mem_end;
+    printf("%s:\n", name);
+    printf("  computed         = physical %.1f MiB, logical %.1f MiB at peak\n",
+           (double) r->peak.physical_bytes / (double) (1 << 20),
+           (double) r->peak.logical_bytes / (double) (1 << 20));
+    printf("  measured         = rss %+.1f MiB, pss %+.1f MiB, peak rss %+.1f MiB\n",
+           mib_delta(a->rss_bytes, b->rss_bytes), mib_delta(a->pss_bytes, b->pss_bytes),
+           mib_delta(a->rss_bytes, b->peak_rss_bytes));
+    if (b->anon_huge_bytes > 0 || b->hugetlb_bytes > 0) {
+        printf("  huge pages       = thp %+.1f MiB, hugetlb %+.1f MiB\n",
+               mib_delta(a->anon_huge_bytes, b->anon_huge_bytes),
+               mib_delta(a->hugetlb_bytes, b->hugetlb_bytes));
+    }
+    printf("  wall             = %.3f s\n", wall);
+}
+
+// The default workload with the backends writing their KV
+// (SimConfig::touch_kv), so the kernel has to commit it: computed physical
+// bytes against measured RSS/PSS, and the wall time the page faults and
+// memory bandwidth add. Without touch_kv, RSS does not move.
+static void run_touch_scenario(SimConfig cfg) {
+    SequenceWork* work = generate_workload(&cfg);
+    SimReport rep;
+
+    static const struct {
+        const char* name;
+        int paged;
+        int touch_kv;
+        ArenaBacking backing;
+    } runs[] = {
+        { "Monolithic (bookkeeping only)",         0, 0, ARENA_BASE_PAGES },
+        { "Monolithic (touch_kv)",                 0, 1, ARENA_BASE_PAGES },
+        { "Paged+Prefix (bookkeeping only)",       1, 0, ARENA_BASE_PAGES },
+        { "Paged+Prefix (touch_kv)",               1, 1, ARENA_BASE_PAGES },
+        { "Paged+Prefix (touch_kv, huge pages)",   1, 1, ARENA_HUGE_PAGES },
+    };
+    for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); ++i) {
+        cfg.touch_kv      = runs[i].touch_kv;
+        cfg.arena_backing = runs[i].backing;
+        KVBackend* b = runs[i].paged ? create_paged_backend(&cfg) : create_monolithic_backend(&cfg);
+        double t0 = now_sec();
+        run_simulation_report(b, &cfg, work, &rep);
+        double wall = now_sec() - t0;
+        print_touch_report(runs[i].name, &rep, wall);
+        kv_destroy(b);
+    }
+    free(work);
+}
+
+static void print_reclaim_report(const char* name, const SimReport* r, double wall) {
+    const MemStat* a = &r->mem_start;
+    const MemStat* b = &r->mem_end;
+    const PageAllocatorStats* s = &r->counters.alloc;
+    printf("%s:\n", name);
+    printf("  computed         = physical mean %.1f MiB, peak %.1f MiB\n",
+           r->mean_physical_bytes / (double) (1 << 20),
+           (double) r->peak.physical_bytes / (double) (1 << 20));
+    printf("  measured         = rss mean %+.1f MiB, peak %+.1f MiB, end %+.1f MiB (lazy free %.1f MiB)\n",
+           r->mean_rss_bytes / (double) (1 << 20), mib_delta(a->rss_bytes, b->peak_rss_bytes),
+           mib_delta(a->rss_bytes, b->rss_bytes), (double) b->lazyfree_bytes / (double) (1 << 20));
+    if (s->reclaimed_pages > 0) {
+        printf("  reclaimed        = %zu pages in %zu madvise calls, %zu uncommitted pages reused\n",
+               s->reclaimed_pages, s->reclaim_calls, s->reclaim_reuses);
+    }
+    if (s->reclaim_failures > 0) {
+        printf("  madvise failed   = %zu calls\n", s->reclaim_failures);
+    }
+    printf("  wall             = %.3f s\n", wall);
+}
+
+// Continuous serving with the KV written (SimConfig::touch_kv): without
+// reclaim, RSS climbs to the most pages ever used and stays there. Giving
+// runs of free pages back when sequences finish (past a warm floor), or
+// above a high-water mark, lets it follow the pages in use, at the price
+// of faulting them in again.
+static void run_reclaim_scenario(SimConfig cfg) {
+    cfg.driver        = SIM_DRIVER_CONTINUOUS;
+    cfg.num_sequences = 1024;
+    cfg.arrival_rate  = 10.0;
+    cfg.touch_kv      = 1;
+
+    SequenceWork* work = generate_workload(&cfg);
+    SimReport rep;
+
+    static const struct {
+        const char* name;
+        int paged;
+        PageReclaim reclaim;
+        ReclaimAdvice advice;
+        size_t high_water;
+        size_t keep_pages;
+    } runs[] = {
+        { "Monolithic (malloc)",                      0, RECLAIM_NONE,       RECLAIM_DONTNEED, 0,    0 },
+        { "Paged+Prefix (no reclaim)",                1, RECLAIM_NONE,       RECLAIM_DONTNEED, 0,    0 },
+        { "Paged+Prefix (on finish, MADV_DONTNEED)",  1, RECLAIM_ON_FINISH,  RECLAIM_DONTNEED, 0,    256 },
+        { "Paged+Prefix (on finish, MADV_FREE)",      1, RECLAIM_ON_FINISH,  RECLAIM_FREE,     0,    256 },
+        { "Paged+Prefix (high water 1024, DONTNEED)", 1, RECLAIM_HIGH_WATER, RECLAIM_DONTNEED, 1024, 0 },
+    };
+    // Runs of 4 pages and up: the LIFO free list rarely frees 2 MiB together.
+    cfg.reclaim_min_run_bytes = (size_t) 512 << 10;
+    for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); ++i) {
+        cfg.reclaim            = runs[i].reclaim;
+        cfg.reclaim_advice     = runs[i].advice;
+        cfg.reclaim_high_water = runs[i].high_water;
+        cfg.reclaim_keep_pages = runs[i].keep_pages;
+        KVBackend* b = runs[i].paged ? create_paged_backend(&cfg) : create_monolithic_backend(&cfg);
+        double t0 = now_sec();
+        run_simulation_report(b, &cfg, work, &rep);
+        double wall = now_sec() - t0;
+        print_reclaim_report(runs[i].name, &rep, wall);
+        kv_destroy(b);
+    }
+    free(work);
+}
+
+// Many system prompts and multi-turn chats whose later turns resend the
+// history: group prefixes only share the system prompt, the radix and hash
+// caches also find earlier turns. The working set outgrows the arena, so
+// the eviction policy decides which idle prefixes survive.
+static void run_prefix_scenario(SimConfig cfg) {
+    cfg.driver             = SIM_DRIVER_CONTINUOUS;
+    cfg.arena_bytes        = (size_t) 4 << 30;
+    cfg.num_sequences      = 4096;
+    cfg.arrival_rate       = 10.0;
+    cfg.num_groups         = 256;      // distinct system prompts
+    cfg.conversation_turns = 8;
+    cfg.max_prompt_extra   = 128;
+    cfg.min_gen_tokens     = 64;
+    cfg.max_gen_tokens     = 256;
+
+    SequenceWork* work = generate_workload(&cfg);
+    SimReport rep;
+
+    static const struct {
+        const char* name;
+        PrefixCacheMode mode;
+        EvictPolicy evict;
+    } modes[] = {
+        { "Paged (prefix groups, LRU)", PREFIX_CACHE_GROUPS, EVICT_LRU },
+        { "Paged (radix cache, LRU)",   PREFIX_CACHE_RADIX,  EVICT_LRU },
+        { "Paged (radix cache, LFU)",   PREFIX_CACHE_RADIX,  EVICT_LFU },
+        { "Paged (radix cache, cost)",  PREFIX_CACHE_RADIX,  EVICT_COST },
+        { "Paged (hash cache, LRU)",    PREFIX_CACHE_HASH,   EVICT_LRU },
+        { "Paged (hash cache, LFU)",    PREFIX_CACHE_HASH,   EVICT_LFU },
+        { "Paged (hash cache, cost)",   PREFIX_CACHE_HASH,   EVICT_COST },
+    };
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i) {
+        cfg.prefix_cache = modes[i].mode;
+        cfg.cache_evict  = modes[i].evict;
+        KVBackend* paged = create_paged_backend(&cfg);
+        run_simulation_report(paged, &cfg, work, &rep);
+        print_report(modes[i].name, &rep);
+        kv_destroy(paged);
+    }
+    free(work);
+}
+
+int main(int argc, char** argv) {
     srand((unsigned int) time(NULL));
 
-    SimConfig cfg;
+    SimConfig cfg = {0};
     cfg.num_layers       = 4;
     cfg.num_heads        = 8;
     cfg.head_dim         = 64;
@@ -35,16 +508,54 @@ int main(void) {
 
     cfg.tokens_per_page  = 16;         // common-ish simulator choice
     cfg.arena_bytes      = (size_t)2 << 30; // 2 GiB arena
+    cfg.freelist         = PAGE_FREELIST_LOCKFREE;
+    cfg.page_cache_pages = 32;         // per-worker page magazine
 
     cfg.num_sequences    = 128;
     cfg.num_groups       = 4;          // enables prefix sharing groups
     cfg.max_prompt_extra = 256;
     cfg.min_gen_tokens   = 128;
     cfg.max_gen_tokens   = 1024;
-    cfg.enable_sleep     = 0;
+    cfg.cost             = cost_model_default();
+
+    cfg.driver           = SIM_DRIVER_WORKER_POOL;
+    cfg.num_workers      = 0;          // one per core
 
     printf("bytes_per_token = %zu\n", bytes_per_token(&cfg));
 
+    if (argc > 1 && strcmp(argv[1], "continuous") == 0) {
+        run_continuous_scenario(cfg);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "prefix") == 0) {
+        run_prefix_scenario(cfg);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "beam") == 0) {
+        run_beam_scenario(cfg);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "spec") == 0) {
+        run_spec_scenario(cfg);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "chunked") == 0) {
+        run_chunked_scenario(cfg);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "window") == 0) {
+        run_window_scenario(cfg);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "touch") == 0) {
+        run_touch_scenario(cfg);
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "reclaim") == 0) {
+        run_reclaim_scenario(cfg);
+        return 0;
+    }
+
     SequenceWork* work = generate_workload(&cfg);
 
     KVBackend* mono = create_monolithic_backend(&cfg);
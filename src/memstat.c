@@ -0,0 +1,62 @@
+#define _XOPEN_SOURCE 700   // sysconf
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "memstat.h"
+
+// "Name:   1234 kB" lines, as in smaps_rollup and status.
+static int read_kb_line(const char* line, char* name, size_t* bytes) {
+    size_t kb;
+    if (sscanf(line, "%31[^:]: %zu kB", name, &kb) != 2) return 0;
+    *bytes = kb << 10;
+    return 1;
+}
+
+int memstat_read(MemStat* out) {
+    memset(out, 0, sizeof(*out));
+    char line[256];
+    char name[32];
+    size_t bytes;
+
+    FILE* f = fopen("/proc/self/smaps_rollup", "r");
+    if (!f) return -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (!read_kb_line(line, name, &bytes)) continue;
+        if (strcmp(name, "Rss") == 0) out->rss_bytes = bytes;
+        else if (strcmp(name, "Pss") == 0) out->pss_bytes = bytes;
+        else if (strcmp(name, "Anonymous") == 0) out->anon_bytes = bytes;
+        else if (strcmp(name, "AnonHugePages") == 0) out->anon_huge_bytes = bytes;
+        else if (strcmp(name, "LazyFree") == 0) out->lazyfree_bytes = bytes;
+        else if (strcmp(name, "Shared_Hugetlb") == 0 || strcmp(name, "Private_Hugetlb") == 0) {
+            out->hugetlb_bytes += bytes;
+        }
+    }
+    fclose(f);
+
+    f = fopen("/proc/self/status", "r");
+    if (!f) return -1;
+    while (fgets(line, sizeof(line), f)) {
+        if (read_kb_line(line, name, &bytes) && strcmp(name, "VmHWM") == 0) {
+            out->peak_rss_bytes = bytes;
+            break;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+size_t memstat_rss_bytes(void) {
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    size_t size, resident;
+    int ok = fscanf(f, "%zu %zu", &size, &resident) == 2;
+    fclose(f);
+    return ok ? resident * (size_t) sysconf(_SC_PAGESIZE) : 0;
+}
+
+void memstat_reset_peak(void) {
+    FILE* f = fopen("/proc/self/clear_refs", "w");
+    if (!f) return;
+    fputs("5", f);
+    fclose(f);
+}
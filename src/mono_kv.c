@@ -3,40 +3,49 @@
 #include <pthread.h>
 #include "kv_backend.h"
 #include "sim_config.h"
+#include "seq_table.h"
 
 typedef struct MonoSeqState {
     size_t max_tokens;
     size_t cur_tokens;
     size_t bytes_per_token;
-    unsigned char* kv_buffer; // optional: to stress RSS
+    unsigned char* kv_buffer; // only written with SimConfig::touch_kv
+    int live;                 // between init/fork and finish
 } MonoSeqState;
 
 typedef struct MonoKVImpl {
     SimConfig cfg;
-    MonoSeqState* seqs;
+    SeqTable seqs;            // of MonoSeqState; entries never move
     size_t num_seqs;
-    size_t capacity;
+    SeqId* free_ids;          // finished ids, reused before num_seqs grows
+    size_t num_free;
+    size_t live_bytes;        // sum of kv_buffer sizes not yet finished
     pthread_mutex_t mutex;
 } MonoKVImpl;
 
-static SeqId mono_init_sequence(KVBackend* backend, const SequenceWork* work) {
-    (void)work;
-    MonoKVImpl* impl = (MonoKVImpl*) backend->impl;
-    pthread_mutex_lock(&impl->mutex);
+static MonoSeqState* mono_seq(MonoKVImpl* impl, SeqId id) {
+    return (MonoSeqState*) seq_table_at(&impl->seqs, id);
+}
 
-    if (impl->num_seqs == impl->capacity) {
-        size_t new_cap = impl->capacity == 0 ? 16 : impl->capacity * 2;
-        MonoSeqState* ns = (MonoSeqState*) realloc(impl->seqs, new_cap * sizeof(MonoSeqState));
-        if (!ns) {
-            pthread_mutex_unlock(&impl->mutex);
-            abort();
-        }
-        impl->seqs = ns;
-        impl->capacity = new_cap;
+// arena_bytes doubles as the device memory budget: every sequence reserves
+// its full window up front, and init fails once the windows no longer fit.
+// Caller holds impl->mutex.
+static KVStatus mono_new_seq(MonoKVImpl* impl, SeqId* out) {
+    size_t window_bytes = impl->cfg.max_context_tokens * bytes_per_token(&impl->cfg);
+    if (impl->live_bytes + window_bytes > impl->cfg.arena_bytes) {
+        return KV_ERR_NO_MEMORY;
     }
 
-    SeqId id = impl->num_seqs++;
-    MonoSeqState* s = &impl->seqs[id];
+    if (impl->num_free == 0 && impl->num_seqs == impl->seqs.capacity) {
+        seq_table_reserve(&impl->seqs, impl->num_seqs + 1);
+        SeqId* nf = (SeqId*) realloc(impl->free_ids, impl->seqs.capacity * sizeof(SeqId));
+        if (!nf) abort();
+        impl->free_ids = nf;
+    }
+
+    int recycled = impl->num_free > 0;
+    SeqId id = recycled ? impl->free_ids[impl->num_free - 1] : impl->num_seqs;
+    MonoSeqState* s = mono_seq(impl, id);
     s->bytes_per_token = bytes_per_token(&impl->cfg);
 
     // Realistic fixed allocation: pre-allocate max context window
@@ -45,50 +54,132 @@ static SeqId mono_init_sequence(KVBackend* backend, const SequenceWork* work) {
     s->cur_tokens = 0;
     s->kv_buffer = (unsigned char*) malloc(s->max_tokens * s->bytes_per_token);
     if (!s->kv_buffer) {
-        pthread_mutex_unlock(&impl->mutex);
-        abort();
+        s->max_tokens = 0;
+        return KV_ERR_NO_MEMORY;
     }
+    if (recycled) impl->num_free--;
+    else impl->num_seqs++;
+    s->live = 1;
+    impl->live_bytes += s->max_tokens * s->bytes_per_token;
+    *out = id;
+    return KV_OK;
+}
+
+static KVStatus mono_init_sequence(KVBackend* backend, const SequenceWork* work, SeqId* out) {
+    (void)work;
+    MonoKVImpl* impl = (MonoKVImpl*) backend->impl;
+    pthread_mutex_lock(&impl->mutex);
+    KVStatus st = mono_new_seq(impl, out);
+    pthread_mutex_unlock(&impl->mutex);
+    return st;
+}
 
+// Nothing to share: the child gets its own window and a copy of the history.
+static KVStatus mono_fork_sequence(KVBackend* backend, SeqId parent, const SequenceWork* work,
+                                   SeqId* out) {
+    (void)work;
+    MonoKVImpl* impl = (MonoKVImpl*) backend->impl;
+    pthread_mutex_lock(&impl->mutex);
+    SeqId id;
+    KVStatus st = mono_new_seq(impl, &id);
+    if (st == KV_OK) {
+        MonoSeqState* p = mono_seq(impl, parent);
+        MonoSeqState* s = mono_seq(impl, id);
+        memcpy(s->kv_buffer, p->kv_buffer, p->cur_tokens * p->bytes_per_token);
+        s->cur_tokens = p->cur_tokens;
+        *out = id;
+    }
     pthread_mutex_unlock(&impl->mutex);
-    return id;
+    return st;
+}
+
+// SimConfig::touch_kv: fills tokens [cur_tokens, cur_tokens + n) with K/V
+// bytes. The rest of the window is never touched, so the OS only commits
+// the pages under the tokens.
+static void mono_write_tokens(MonoKVImpl* impl, MonoSeqState* s, size_t n) {
+    if (!impl->cfg.touch_kv || n == 0) return;
+    memset(s->kv_buffer + s->cur_tokens * s->bytes_per_token,
+           (int) (s->cur_tokens & 0xff), n * s->bytes_per_token);
 }
 
-static void mono_append_token(KVBackend* backend, SeqId id) {
+static KVStatus mono_append_token(KVBackend* backend, SeqId id) {
     MonoKVImpl* impl = (MonoKVImpl*) backend->impl;
-    MonoSeqState* s = &impl->seqs[id];
+    MonoSeqState* s = mono_seq(impl, id);
     if (s->cur_tokens < s->max_tokens) {
+        mono_write_tokens(impl, s, 1);
         s->cur_tokens++;
     }
+    return KV_OK;
+}
+
+static KVStatus mono_append_tokens(KVBackend* backend, SeqId id, size_t n, size_t* appended) {
+    MonoKVImpl* impl = (MonoKVImpl*) backend->impl;
+    MonoSeqState* s = mono_seq(impl, id);
+    size_t room = s->max_tokens - s->cur_tokens;
+    if (n < room) room = n;
+    mono_write_tokens(impl, s, room);
+    s->cur_tokens += room;
+    if (appended) *appended = n;
+    return KV_OK;
+}
+
+static void mono_truncate_sequence(KVBackend* backend, SeqId id, size_t new_len) {
+    MonoKVImpl* impl = (MonoKVImpl*) backend->impl;
+    MonoSeqState* s = mono_seq(impl, id);
+    if (new_len < s->cur_tokens) s->cur_tokens = new_len;
 }
 
 static void mono_finish_sequence(KVBackend* backend, SeqId id) {
-    (void) backend;
-    (void) id;
-    // no-op; keep them until end for stats
+    MonoKVImpl* impl = (MonoKVImpl*) backend->impl;
+    pthread_mutex_lock(&impl->mutex);
+    if (id < impl->num_seqs && mono_seq(impl, id)->live) {
+        MonoSeqState* s = mono_seq(impl, id);
+        impl->live_bytes -= s->max_tokens * s->bytes_per_token;
+        free(s->kv_buffer);
+        s->kv_buffer  = NULL;
+        s->max_tokens = 0;
+        s->cur_tokens = 0;
+        s->live = 0;
+        impl->free_ids[impl->num_free++] = id;
+    }
+    pthread_mutex_unlock(&impl->mutex);
+}
+
+// Nothing grows after init, so admission is just the init-time check.
+static int mono_can_admit(KVBackend* backend, const SequenceWork* work) {
+    (void) work;
+    MonoKVImpl* impl = (MonoKVImpl*) backend->impl;
+    size_t need = impl->cfg.max_context_tokens * bytes_per_token(&impl->cfg);
+    pthread_mutex_lock(&impl->mutex);
+    int ok = impl->live_bytes + need <= impl->cfg.arena_bytes;
+    pthread_mutex_unlock(&impl->mutex);
+    return ok;
 }
 
 static KVStats mono_stats(KVBackend* backend) {
     MonoKVImpl* impl = (MonoKVImpl*) backend->impl;
-    KVStats st = {0, 0, 0};
+    KVStats st = {0, 0, 0, 0};
 
     pthread_mutex_lock(&impl->mutex);
     for (size_t i = 0; i < impl->num_seqs; ++i) {
-        MonoSeqState* s = &impl->seqs[i];
+        MonoSeqState* s = mono_seq(impl, i);
         st.logical_tokens += s->cur_tokens;
         st.physical_bytes += s->max_tokens * s->bytes_per_token;
     }
     pthread_mutex_unlock(&impl->mutex);
 
     st.logical_bytes = st.logical_tokens * bytes_per_token(&impl->cfg);
+    st.capacity_bytes = impl->cfg.arena_bytes;
     return st;
 }
 
 static void mono_destroy(KVBackend* backend) {
     MonoKVImpl* impl = (MonoKVImpl*) backend->impl;
     for (size_t i = 0; i < impl->num_seqs; ++i) {
-        free(impl->seqs[i].kv_buffer);
+        free(mono_seq(impl, i)->kv_buffer);
     }
-    free(impl->seqs);
+    seq_table_destroy(&impl->seqs);
+    free(impl->free_ids);
     pthread_mutex_destroy(&impl->mutex);
     free(impl);
     backend->impl = NULL;
@@ -96,11 +187,15 @@ static void mono_destroy(KVBackend* backend) {
 
 // Ensure this VTable is defined (it was likely already there based on the warning)
 static const KVBackendVTable MONO_VTABLE = {
-    .init_sequence   = mono_init_sequence,
-    .append_token    = mono_append_token,
-    .finish_sequence = mono_finish_sequence,
-    .stats           = mono_stats,
-    .destroy         = mono_destroy
+    .init_sequence     = mono_init_sequence,
+    .append_token      = mono_append_token,
+    .append_tokens     = mono_append_tokens,
+    .finish_sequence   = mono_finish_sequence,
+    .truncate_sequence = mono_truncate_sequence,
+    .can_admit         = mono_can_admit,
+    .fork_sequence     = mono_fork_sequence,
+    .stats             = mono_stats,
+    .destroy           = mono_destroy
 };
 
 KVBackend* create_monolithic_backend(const SimConfig* cfg) {
@@ -108,8 +203,9 @@ KVBackend* create_monolithic_backend(const SimConfig* cfg) {
     impl->cfg = *cfg;
     pthread_mutex_init(&impl->mutex, NULL);
 
-    impl->capacity = cfg->num_sequences;
-    impl->seqs = (MonoSeqState*) calloc(impl->capacity, sizeof(MonoSeqState));
+    seq_table_init(&impl->seqs, sizeof(MonoSeqState));
+    seq_table_reserve(&impl->seqs, cfg->num_sequences);
+    impl->free_ids = (SeqId*) calloc(impl->seqs.capacity, sizeof(SeqId));
 
     KVBackend* b = (KVBackend*) calloc(1, sizeof(KVBackend));
     b->impl = impl;
@@ -1,113 +1,951 @@
 #define _GNU_SOURCE 1
 #include <sys/mman.h>
+#include <sched.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
+#include <stdatomic.h>
 #include <pthread.h>
 #include "sim_config.h"
+#include "page_alloc.h"
+#include "free_bitmap.h"
 #include <unistd.h>
 
 #ifndef MAP_ANONYMOUS
 #define MAP_ANONYMOUS MAP_ANON
 #endif
+#ifndef MADV_FREE
+#define MADV_FREE 8
+#endif
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+#define HUGE_2MB ((size_t) 2 << 20)
+#define HUGE_1GB ((size_t) 1 << 30)
+
+// Empty link in the lock-free stack.
+#define LF_NIL UINT32_MAX
+// Most pages one lock-free pop walks.
+#define LF_BATCH 64
+// PAGE_FREELIST_BITMAP: free pages a new run leaves on either side, and how
+// many free runs it looks at to find them.
+#define BITMAP_RUN_SLACK 64
+#define BITMAP_SCAN_RUNS 64
 
 typedef struct Page {
     unsigned char* base;
-    unsigned int ref;
+    atomic_uint ref;         // holders; only the 1 -> 0 transition frees
+    _Atomic uint32_t next;   // lock-free free list link (page index)
+    unsigned char committed; // written since its memory was last given back
 } Page;
 
+// Adjacent committed pages found by a reclaim, as page indices.
+typedef struct ReclaimRun {
+    size_t first;
+    size_t len;
+} ReclaimRun;
+
+// Per-thread cache of free pages in front of the shared free list. Refilled
+// to `size` pages in one go and flushed by half when it reaches 2 * size.
+// The lock is only contended when another thread reclaims stranded pages
+// because the shared list ran dry.
+typedef struct PageMagazine {
+    Page** pages;
+    size_t count;
+    size_t capacity;
+    pthread_mutex_t lock;
+    struct PageAllocator* pa;
+    struct PageMagazine* next;
+} PageMagazine;
+
 typedef struct PageAllocator {
     unsigned char* arena;
+    size_t map_bytes;            // arena mapping, rounded up to huge pages
+    ArenaPages backing;
+    size_t huge_page_bytes;
     size_t page_bytes;
     size_t num_pages;
     Page*  pages;
+    PageFreeList mode;
+
+    // SimConfig::arena_segment_bytes: the arena is reserved up front and its
+    // segments made writable, described and put on the free list one at a
+    // time, when the free list runs dry. Descriptors of closed segments are
+    // never touched. Without segments the whole arena is segment 0.
+    int lazy;
+    size_t seg_pages;
+    size_t num_segments;
+    atomic_size_t segments_open;
+    pthread_mutex_t grow_lock;
 
+    // PAGE_FREELIST_MUTEX
     Page** free_list;
     size_t free_count;
     size_t free_capacity;
 
+    // PAGE_FREELIST_LOCKFREE: (tag << 32) | top page index. The tag changes
+    // on every successful CAS so a pop that raced a pop+push of the same
+    // page fails instead of installing a stale next link (ABA).
+    _Atomic uint64_t lf_head;
+
+    // PAGE_FREELIST_BITMAP: bit i set while pages[i] is free; new runs are
+    // looked for from `rover` on.
+    FreeBitmap free_bits;
+    size_t rover;
+
+    // Guards the mutex free list and the bitmap.
     pthread_mutex_t mutex;
+
+    // SimConfig::reclaim. Free pages whose memory went back to the kernel
+    // wait on their own stack, so allocation takes committed ones first.
+    PageReclaim reclaim;
+    int advice;                  // MADV_DONTNEED or MADV_FREE
+    size_t reclaim_unit;         // madvise granularity, see page_allocator_create
+    size_t min_run_pages;        // shortest run released (reclaim_min_run_bytes)
+    size_t high_water;
+    Page** released;             // under released_lock
+    size_t num_released;
+    pthread_mutex_t released_lock;
+    pthread_mutex_t reclaim_lock;   // one reclaim at a time; owns the buffers
+    Page** reclaim_buf;
+    FreeBitmap reclaim_marks;    // the committed pages reclaim_buf holds
+    ReclaimRun* runs;
+    atomic_int reclaiming;       // set while a reclaim holds the shared list
+    atomic_size_t reclaim_left;  // committed free pages the last reclaim kept
+
+    // One magazine per (thread, allocator): mag_key holds the calling
+    // thread's, and its destructor returns the pages and unlinks the
+    // magazine when the thread exits.
+    size_t mag_size;             // 0 => no magazines
+    pthread_key_t mag_key;
+    PageMagazine* mags;          // every live thread's magazine, under mags_lock
+    pthread_mutex_t mags_lock;
+
+    // Running counters, on their own cache line so sampling them never
+    // bounces the free list head. Relaxed: each is exact on its own, a
+    // snapshot across them is not atomic.
+    _Alignas(64) atomic_size_t in_use;
+    atomic_size_t peak_in_use;
+    atomic_size_t allocs;
+    atomic_size_t frees;
+    atomic_size_t failed_allocs;
+    atomic_size_t committed_free;
+    atomic_size_t reclaimed_pages;
+    atomic_size_t reclaim_calls;
+    atomic_size_t reclaim_failures;
+    atomic_size_t reclaim_reuses;
 } PageAllocator;
 
+static size_t round_up(size_t n, size_t align) {
+    return (n + align - 1) / align * align;
+}
+
+static size_t gcd(size_t a, size_t b) {
+    while (b != 0) {
+        size_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static inline uint64_t lf_pack(uint64_t head, uint32_t idx) {
+    return (((head >> 32) + 1) << 32) | idx;
+}
+
+// Pops up to n pages with one CAS: walks n links down from the top and
+// swings the head past them. Any push or pop in between changes the tag, so
+// a walk over links that moved under us fails the CAS and starts over.
+static size_t lf_pop_n(PageAllocator* pa, Page** out, size_t n) {
+    uint64_t head = atomic_load_explicit(&pa->lf_head, memory_order_acquire);
+    for (;;) {
+        uint32_t idx = (uint32_t) head;
+        size_t got = 0;
+        while (got < n && idx != LF_NIL) {
+            out[got++] = &pa->pages[idx];
+            idx = atomic_load_explicit(&pa->pages[idx].next, memory_order_relaxed);
+        }
+        if (got == 0) return 0;
+        if (atomic_compare_exchange_weak_explicit(&pa->lf_head, &head, lf_pack(head, idx),
+                                                  memory_order_acquire,
+                                                  memory_order_acquire)) {
+            return got;
+        }
+    }
+}
+
+// Links the batch into a chain first, so it goes on with one CAS.
+static void lf_push_n(PageAllocator* pa, Page** in, size_t n) {
+    if (n == 0) return;
+    for (size_t i = 0; i + 1 < n; ++i) {
+        atomic_store_explicit(&in[i]->next, (uint32_t) (in[i + 1] - pa->pages),
+                              memory_order_relaxed);
+    }
+    Page* tail = in[n - 1];
+    uint32_t top = (uint32_t) (in[0] - pa->pages);
+    uint64_t head = atomic_load_explicit(&pa->lf_head, memory_order_relaxed);
+    do {
+        atomic_store_explicit(&tail->next, (uint32_t) head, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&pa->lf_head, &head, lf_pack(head, top),
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+}
+
+// Where a new run of n pages starts: BITMAP_RUN_SLACK pages into the first
+// free run with that much room on either side, so both it and whatever ends
+// before the run can grow in place, else halfway into the longest of the
+// BITMAP_SCAN_RUNS looked at. The scan starts where the last new run did
+// (next fit), so the holes left behind are not searched again every time,
+// and runs are only measured as far as they need to be.
+static size_t bitmap_run_start(const FreeBitmap* b, size_t from, size_t n) {
+    size_t want = n + 2 * BITMAP_RUN_SLACK;
+    size_t best = FREE_BITMAP_NONE;
+    size_t best_len = 0;
+    size_t i = free_bitmap_next(b, from);
+    for (size_t runs = 0; runs < BITMAP_SCAN_RUNS; ++runs) {
+        if (i == FREE_BITMAP_NONE) {
+            if (from == 0) break;
+            i = free_bitmap_next(b, from = 0);
+            continue;
+        }
+        size_t end = free_bitmap_run_end(b, i, i + want);
+        if (end - i > best_len) {
+            best = i;
+            best_len = end - i;
+            if (best_len == want) break;
+        }
+        i = free_bitmap_next(b, end);
+    }
+    if (best_len > n) best += (best_len - n) / 2;
+    return best;
+}
+
+// Caller holds pa->mutex. The pages right after `after` first, then a new
+// run, continuing into the next free pages when it is too short, and past
+// the end of the arena round to the ones below where the run started.
+static size_t bitmap_take(PageAllocator* pa, const Page* after, Page** out, size_t n) {
+    FreeBitmap* b = &pa->free_bits;
+    size_t got = 0;
+    if (after) {
+        size_t i = (size_t) (after - pa->pages) + 1;
+        while (got < n && i < pa->num_pages && free_bitmap_test(b, i)) {
+            free_bitmap_clear(b, i);
+            out[got++] = &pa->pages[i++];
+        }
+    }
+    if (got == n) return got;
+    size_t start = bitmap_run_start(b, pa->rover, n - got);
+    if (start == FREE_BITMAP_NONE) return got;
+    pa->rover = start;
+    size_t i = start;
+    int wrapped = 0;
+    while (got < n) {
+        if (i == FREE_BITMAP_NONE && !wrapped) {
+            wrapped = 1;
+            i = free_bitmap_next(b, 0);
+        }
+        if (i == FREE_BITMAP_NONE || (wrapped && i >= start)) break;
+        free_bitmap_clear(b, i);
+        out[got++] = &pa->pages[i];
+        i = free_bitmap_next(b, i + 1);
+    }
+    return got;
+}
+
+// Shared free list, n pages at a time. The mutex list and the bitmap do the
+// whole batch under one lock acquisition; only the bitmap places pages
+// after `after`.
+static size_t stack_pop_n(PageAllocator* pa, const Page* after, Page** out, size_t n) {
+    size_t got = 0;
+    if (pa->mode == PAGE_FREELIST_LOCKFREE) {
+        // Bounded walks, so a retried CAS never re-reads a long chain.
+        while (got < n) {
+            size_t k = lf_pop_n(pa, out + got, n - got < LF_BATCH ? n - got : LF_BATCH);
+            if (k == 0) break;
+            got += k;
+        }
+        return got;
+    }
+    pthread_mutex_lock(&pa->mutex);
+    if (pa->mode == PAGE_FREELIST_BITMAP) {
+        got = bitmap_take(pa, after, out, n);
+    } else {
+        while (got < n && pa->free_count > 0) {
+            out[got++] = pa->free_list[--pa->free_count];
+        }
+    }
+    pthread_mutex_unlock(&pa->mutex);
+    return got;
+}
+
+static void stack_push_n(PageAllocator* pa, Page** in, size_t n) {
+    if (pa->mode == PAGE_FREELIST_LOCKFREE) {
+        lf_push_n(pa, in, n);
+        return;
+    }
+    pthread_mutex_lock(&pa->mutex);
+    if (pa->mode == PAGE_FREELIST_BITMAP) {
+        for (size_t i = 0; i < n; ++i) free_bitmap_set(&pa->free_bits, (size_t) (in[i] - pa->pages));
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            pa->free_list[pa->free_count++] = in[i];
+        }
+    }
+    pthread_mutex_unlock(&pa->mutex);
+}
+
+static size_t count_committed(Page** pages, size_t n) {
+    size_t c = 0;
+    for (size_t i = 0; i < n; ++i) c += pages[i]->committed;
+    return c;
+}
+
+static size_t released_pop_n(PageAllocator* pa, Page** out, size_t n) {
+    pthread_mutex_lock(&pa->released_lock);
+    size_t got = pa->num_released < n ? pa->num_released : n;
+    pa->num_released -= got;
+    memcpy(out, pa->released + pa->num_released, got * sizeof(Page*));
+    pthread_mutex_unlock(&pa->released_lock);
+    if (got > 0) atomic_fetch_add_explicit(&pa->reclaim_reuses, got, memory_order_relaxed);
+    return got;
+}
+
+static void reclaim_to(PageAllocator* pa, size_t keep, int wait);
+
+// Whether a reclaim down to keep could release at least one minimum run:
+// there must be that many committed free pages beyond keep, and beyond the
+// ones the last reclaim had to leave, which were in runs too short to go.
+static int reclaim_due(PageAllocator* pa, size_t committed, size_t keep) {
+    size_t left = atomic_load_explicit(&pa->reclaim_left, memory_order_relaxed);
+    size_t floor = keep > left ? keep : left;
+    return committed >= floor + pa->min_run_pages;
+}
+
+// Describes the pages of the next segment and puts them on the shared list,
+// the highest first like the initial list. `seen` is the number of open
+// segments the caller found before its pop came up short: if another
+// thread opened one since, it retries on that instead. Returns 0 once every
+// segment is open.
+static int segment_open(PageAllocator* pa, size_t seen) {
+    if (seen == pa->num_segments) return 0;
+    pthread_mutex_lock(&pa->grow_lock);
+    size_t s = atomic_load_explicit(&pa->segments_open, memory_order_relaxed);
+    if (s != seen) {
+        pthread_mutex_unlock(&pa->grow_lock);
+        return 1;
+    }
+    size_t first = s * pa->seg_pages;
+    size_t last = first + pa->seg_pages < pa->num_pages ? first + pa->seg_pages : pa->num_pages;
+    if (pa->lazy) {
+        // mprotect works on whole base pages; a neighbour sharing one opens early.
+        size_t unit = (size_t) sysconf(_SC_PAGESIZE);
+        size_t lo = first * pa->page_bytes / unit * unit;
+        size_t hi = round_up(last * pa->page_bytes, unit);
+        if (mprotect(pa->arena + lo, hi - lo, PROT_READ | PROT_WRITE) != 0) abort();
+    }
+    for (size_t i = first; i < last; ++i) {
+        pa->pages[i].base = pa->arena + i * pa->page_bytes;
+        atomic_init(&pa->pages[i].ref, 0);
+        pa->pages[i].committed = 0;
+        atomic_init(&pa->pages[i].next, i == first ? LF_NIL : (uint32_t) (i - 1));
+    }
+    if (last > first) {
+        if (pa->mode == PAGE_FREELIST_LOCKFREE) {
+            Page* bottom = &pa->pages[first];
+            uint64_t head = atomic_load_explicit(&pa->lf_head, memory_order_relaxed);
+            do {
+                atomic_store_explicit(&bottom->next, (uint32_t) head, memory_order_relaxed);
+            } while (!atomic_compare_exchange_weak_explicit(&pa->lf_head, &head,
+                                                            lf_pack(head, (uint32_t) (last - 1)),
+                                                            memory_order_release,
+                                                            memory_order_relaxed));
+        } else if (pa->mode == PAGE_FREELIST_BITMAP) {
+            pthread_mutex_lock(&pa->mutex);
+            for (size_t i = first; i < last; ++i) free_bitmap_set(&pa->free_bits, i);
+            pthread_mutex_unlock(&pa->mutex);
+        } else {
+            pthread_mutex_lock(&pa->mutex);
+            for (size_t i = first; i < last; ++i) pa->free_list[pa->free_count++] = &pa->pages[i];
+            pthread_mutex_unlock(&pa->mutex);
+        }
+    }
+    atomic_store_explicit(&pa->segments_open, s + 1, memory_order_release);
+    pthread_mutex_unlock(&pa->grow_lock);
+    return 1;
+}
+
+// Committed pages first. With reclaim on, released ones next: a reclaim
+// holds the whole shared list for a moment, so wait for it rather than
+// fault in released pages or fail. The acquire fence pairs with the release
+// fence in reclaim_to, so a pop that came up empty because of it also sees
+// `reclaiming` set. New segments open only when all of that comes up short.
+// Each retry places its pages after the last ones it got.
+static size_t freelist_pop_n(PageAllocator* pa, const Page* after, Page** out, size_t n) {
+    size_t got = 0;
+    for (;;) {
+        size_t opened = atomic_load_explicit(&pa->segments_open, memory_order_acquire);
+        size_t from = got;
+        got += stack_pop_n(pa, got > 0 ? out[got - 1] : after, out + got, n - got);
+        if (pa->reclaim != RECLAIM_NONE) {
+            while (got < n) {
+                atomic_thread_fence(memory_order_acquire);
+                int busy = atomic_load_explicit(&pa->reclaiming, memory_order_acquire);
+                got += stack_pop_n(pa, got > 0 ? out[got - 1] : after, out + got, n - got);
+                if (!busy) break;
+                sched_yield();
+            }
+            size_t committed = count_committed(out + from, got - from);
+            if (committed > 0) {
+                atomic_fetch_sub_explicit(&pa->committed_free, committed, memory_order_relaxed);
+            }
+            if (got < n) got += released_pop_n(pa, out + got, n - got);
+        }
+        if (got == n || !segment_open(pa, opened)) return got;
+    }
+}
+
+static void freelist_push_n(PageAllocator* pa, Page** in, size_t n) {
+    if (pa->reclaim == RECLAIM_NONE) {
+        stack_push_n(pa, in, n);
+        return;
+    }
+    size_t committed = count_committed(in, n);
+    committed += atomic_fetch_add_explicit(&pa->committed_free, committed, memory_order_relaxed);
+    stack_push_n(pa, in, n);
+    if (pa->reclaim == RECLAIM_HIGH_WATER && committed > pa->high_water &&
+        reclaim_due(pa, committed, pa->high_water / 2)) {
+        reclaim_to(pa, pa->high_water / 2, 0);
+    }
+}
+
+static PageMagazine* magazine_get(PageAllocator* pa) {
+    PageMagazine* m = (PageMagazine*) pthread_getspecific(pa->mag_key);
+    if (m) return m;
+
+    m = (PageMagazine*) calloc(1, sizeof(PageMagazine));
+    if (!m) abort();
+    m->capacity = 2 * pa->mag_size;
+    m->pages = (Page**) malloc(m->capacity * sizeof(Page*));
+    if (!m->pages) abort();
+    pthread_mutex_init(&m->lock, NULL);
+    m->pa = pa;
+
+    pthread_mutex_lock(&pa->mags_lock);
+    m->next = pa->mags;
+    pa->mags = m;
+    pthread_mutex_unlock(&pa->mags_lock);
+
+    if (pthread_setspecific(pa->mag_key, m) != 0) abort();
+    return m;
+}
+
+// Caller holds m->lock.
+static void magazine_flush(PageAllocator* pa, PageMagazine* m, size_t n) {
+    freelist_push_n(pa, m->pages + (m->count - n), n);
+    m->count -= n;
+}
+
+static void magazine_free(PageMagazine* m) {
+    pthread_mutex_destroy(&m->lock);
+    free(m->pages);
+    free(m);
+}
+
+// mag_key destructor: the thread is exiting (worker pools end theirs when
+// destroyed), so its pages go back to the shared list instead of waiting
+// for a shortage to reclaim them. Allocators must outlive their threads.
+static void magazine_exit(void* arg) {
+    PageMagazine* m = (PageMagazine*) arg;
+    PageAllocator* pa = m->pa;
+    pthread_mutex_lock(&pa->mags_lock);
+    PageMagazine** link = &pa->mags;
+    while (*link != m) link = &(*link)->next;
+    *link = m->next;
+    pthread_mutex_lock(&m->lock);
+    magazine_flush(pa, m, m->count);
+    pthread_mutex_unlock(&m->lock);
+    pthread_mutex_unlock(&pa->mags_lock);
+    magazine_free(m);
+}
+
+// The shared list is empty: push every magazine's pages back to it so the
+// caller can refill. Called without holding any magazine lock.
+static void magazines_reclaim(PageAllocator* pa) {
+    pthread_mutex_lock(&pa->mags_lock);
+    for (PageMagazine* m = pa->mags; m; m = m->next) {
+        pthread_mutex_lock(&m->lock);
+        magazine_flush(pa, m, m->count);
+        pthread_mutex_unlock(&m->lock);
+    }
+    pthread_mutex_unlock(&pa->mags_lock);
+}
+
+static Page* magazine_alloc(PageAllocator* pa) {
+    PageMagazine* m = magazine_get(pa);
+    pthread_mutex_lock(&m->lock);
+    if (m->count == 0) {
+        m->count = freelist_pop_n(pa, NULL, m->pages, pa->mag_size);
+    }
+    if (m->count == 0) {
+        pthread_mutex_unlock(&m->lock);
+        magazines_reclaim(pa);
+        pthread_mutex_lock(&m->lock);
+        m->count = freelist_pop_n(pa, NULL, m->pages, pa->mag_size);
+        if (m->count == 0) {
+            pthread_mutex_unlock(&m->lock);
+            return NULL;
+        }
+    }
+    Page* p = m->pages[--m->count];
+    pthread_mutex_unlock(&m->lock);
+    return p;
+}
+
+// Drains the magazine first and takes the rest straight from the shared
+// list, so a large batch does not cycle through the magazine.
+static size_t magazine_alloc_n(PageAllocator* pa, Page** out, size_t n) {
+    PageMagazine* m = magazine_get(pa);
+    pthread_mutex_lock(&m->lock);
+    size_t got = m->count < n ? m->count : n;
+    m->count -= got;
+    memcpy(out, m->pages + m->count, got * sizeof(Page*));
+    pthread_mutex_unlock(&m->lock);
+
+    got += freelist_pop_n(pa, NULL, out + got, n - got);
+    if (got < n) {
+        magazines_reclaim(pa);
+        got += freelist_pop_n(pa, NULL, out + got, n - got);
+    }
+    return got;
+}
+
+// A batch of at least a magazine's size skips it and goes to the shared list
+// in one push; smaller ones flush half the magazine if they do not fit.
+static void magazine_free_n(PageAllocator* pa, Page** in, size_t n) {
+    if (n >= pa->mag_size) {
+        freelist_push_n(pa, in, n);
+        return;
+    }
+    PageMagazine* m = magazine_get(pa);
+    pthread_mutex_lock(&m->lock);
+    if (m->count + n > m->capacity) {
+        magazine_flush(pa, m, m->capacity / 2);
+    }
+    memcpy(m->pages + m->count, in, n * sizeof(Page*));
+    m->count += n;
+    pthread_mutex_unlock(&m->lock);
+}
+
+// MAP_HUGETLB only succeeds with huge pages reserved up front, so it is
+// tried first (1 GiB pages only for arenas that big) and transparent huge
+// pages are the fallback. A lazy arena is only reserved: no access and no
+// commit charge until segment_open makes a segment writable, and hugetlb,
+// which cannot be committed piecemeal, is skipped. Sets map_bytes, backing
+// and huge_page_bytes.
+static unsigned char* arena_map(PageAllocator* pa, size_t bytes, ArenaBacking want) {
+    const int prot = pa->lazy ? PROT_NONE : PROT_READ | PROT_WRITE;
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS | (pa->lazy ? MAP_NORESERVE : 0);
+    pa->map_bytes = bytes;
+    pa->backing = ARENA_PAGES_BASE;
+    pa->huge_page_bytes = 0;
+    if (want != ARENA_HUGE_PAGES) {
+        return (unsigned char*) mmap(NULL, bytes, prot, flags, -1, 0);
+    }
+
+    static const struct {
+        size_t bytes;
+        int flag;
+    } sizes[] = {
+        { HUGE_1GB, MAP_HUGE_1GB },
+        { HUGE_2MB, MAP_HUGE_2MB },
+    };
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]) && !pa->lazy; ++i) {
+        if (bytes < sizes[i].bytes && sizes[i].bytes > HUGE_2MB) continue;
+        size_t len = round_up(bytes, sizes[i].bytes);
+        void* p = mmap(NULL, len, prot, flags | MAP_HUGETLB | sizes[i].flag, -1, 0);
+        if (p != MAP_FAILED) {
+            pa->map_bytes = len;
+            pa->backing = ARENA_PAGES_HUGETLB;
+            pa->huge_page_bytes = sizes[i].bytes;
+            return (unsigned char*) p;
+        }
+    }
+
+    // Over-map and trim so the arena starts on a 2 MiB boundary; otherwise
+    // no 2 MiB run of it lines up with a huge page.
+    size_t len = round_up(bytes, HUGE_2MB);
+    unsigned char* raw = (unsigned char*) mmap(NULL, len + HUGE_2MB, prot, flags, -1, 0);
+    if (raw == MAP_FAILED) return raw;
+    unsigned char* p = (unsigned char*) round_up((size_t) raw, HUGE_2MB);
+    if (p > raw) munmap(raw, (size_t) (p - raw));
+    munmap(p + len, (size_t) (raw + HUGE_2MB - p));
+    pa->map_bytes = len;
+    if (madvise(p, len, MADV_HUGEPAGE) == 0) {
+        pa->backing = ARENA_PAGES_THP;
+        pa->huge_page_bytes = HUGE_2MB;
+    }
+    return p;
+}
+
+static int cmp_run_len_desc(const void* a, const void* b) {
+    const ReclaimRun* x = (const ReclaimRun*) a;
+    const ReclaimRun* y = (const ReclaimRun*) b;
+    return (x->len < y->len) - (x->len > y->len);
+}
+
+// Takes the whole shared list and gives back runs of at least min_run_pages
+// adjacent committed pages, longest first, one madvise each, until at most
+// keep are left. The runs come from marking the pages by index and scanning
+// the marks, so the list is never sorted. Only whole reclaim_units inside a
+// run go: madvise needs system (or huge) page alignment, hugetlb requires
+// whole huge pages and a partial THP would be split. Every page still
+// committed goes back on the shared list, the rest on `released`. Without
+// wait, returns at once if another reclaim is running.
+static void reclaim_to(PageAllocator* pa, size_t keep, int wait) {
+    if (wait) pthread_mutex_lock(&pa->reclaim_lock);
+    else if (pthread_mutex_trylock(&pa->reclaim_lock) != 0) return;
+    atomic_fetch_add_explicit(&pa->reclaiming, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    Page** buf = pa->reclaim_buf;
+    FreeBitmap* marks = &pa->reclaim_marks;
+    size_t n = stack_pop_n(pa, NULL, buf, pa->num_pages);
+    size_t have = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (!buf[i]->committed) continue;
+        free_bitmap_set(marks, (size_t) (buf[i] - pa->pages));
+        have++;
+    }
+    if (have > 0) atomic_fetch_sub_explicit(&pa->committed_free, have, memory_order_relaxed);
+
+    size_t num_runs = 0;
+    size_t i = free_bitmap_next(marks, 0);
+    while (i != FREE_BITMAP_NONE) {
+        size_t end = free_bitmap_run_end(marks, i, pa->num_pages);
+        if (end - i >= pa->min_run_pages) {
+            pa->runs[num_runs].first = i;
+            pa->runs[num_runs].len = end - i;
+            num_runs++;
+        }
+        i = free_bitmap_next(marks, end);
+    }
+    for (size_t j = 0; j < n; ++j) {
+        if (buf[j]->committed) free_bitmap_clear(marks, (size_t) (buf[j] - pa->pages));
+    }
+    qsort(pa->runs, num_runs, sizeof(ReclaimRun), cmp_run_len_desc);
+
+    size_t released = 0;
+    size_t calls = 0;
+    size_t failures = 0;
+    for (size_t r = 0; r < num_runs && have > keep; ++r) {
+        size_t first = pa->runs[r].first;
+        size_t lo = round_up(first * pa->page_bytes, pa->reclaim_unit);
+        size_t hi = (first + pa->runs[r].len) * pa->page_bytes / pa->reclaim_unit * pa->reclaim_unit;
+        if (hi <= lo) continue;
+        if (madvise(pa->arena + lo, hi - lo, pa->advice) != 0) {
+            failures++;
+            continue;
+        }
+        calls++;
+        for (size_t p = lo / pa->page_bytes; p < hi / pa->page_bytes; ++p) {
+            pa->pages[p].committed = 0;
+            released++;
+            have--;
+        }
+    }
+
+    size_t kept = 0;
+    pthread_mutex_lock(&pa->released_lock);
+    for (size_t j = 0; j < n; ++j) {
+        if (buf[j]->committed) buf[kept++] = buf[j];
+        else pa->released[pa->num_released++] = buf[j];
+    }
+    pthread_mutex_unlock(&pa->released_lock);
+    atomic_fetch_add_explicit(&pa->committed_free, kept, memory_order_relaxed);
+    stack_push_n(pa, buf, kept);
+
+    atomic_store_explicit(&pa->reclaim_left, have, memory_order_relaxed);
+    atomic_fetch_add_explicit(&pa->reclaimed_pages, released, memory_order_relaxed);
+    atomic_fetch_add_explicit(&pa->reclaim_calls, calls, memory_order_relaxed);
+    atomic_fetch_add_explicit(&pa->reclaim_failures, failures, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&pa->reclaiming, 1, memory_order_release);
+    pthread_mutex_unlock(&pa->reclaim_lock);
+}
+
 PageAllocator* page_allocator_create(const SimConfig* cfg) {
     PageAllocator* pa = (PageAllocator*) calloc(1, sizeof(PageAllocator));
     if (!pa) abort();
 
     pa->page_bytes = cfg->tokens_per_page * bytes_per_token(cfg);
     pa->num_pages  = cfg->arena_bytes / pa->page_bytes;
+    pa->mode       = cfg->freelist;
+    if (pa->mode == PAGE_FREELIST_LOCKFREE && pa->num_pages >= LF_NIL) abort();
 
-    size_t arena_size = pa->num_pages * pa->page_bytes;
-    pa->arena = (unsigned char*) mmap(NULL, arena_size,
-                                      PROT_READ | PROT_WRITE,
-                                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    size_t seg_pages = cfg->arena_segment_bytes / pa->page_bytes;
+    pa->lazy = seg_pages > 0 && seg_pages < pa->num_pages;
+    pa->seg_pages = pa->lazy ? seg_pages : pa->num_pages;
+    pa->num_segments = pa->num_pages == 0 ? 0 : (pa->num_pages + pa->seg_pages - 1) / pa->seg_pages;
+    atomic_init(&pa->segments_open, 0);
+    pthread_mutex_init(&pa->grow_lock, NULL);
+
+    pa->arena = arena_map(pa, pa->num_pages * pa->page_bytes, cfg->arena_backing);
     if (pa->arena == MAP_FAILED) {
         free(pa);
         abort();
     }
 
+    // Large enough to come straight from mmap, so a lazy arena's
+    // descriptors and list slots are only committed as segments open.
     pa->pages = (Page*) malloc(pa->num_pages * sizeof(Page));
-    pa->free_list = (Page**) malloc(pa->num_pages * sizeof(Page*));
-    pa->free_capacity = pa->num_pages;
+    if (!pa->pages) abort();
+    if (pa->mode == PAGE_FREELIST_MUTEX) {
+        pa->free_list = (Page**) malloc(pa->num_pages * sizeof(Page*));
+        if (!pa->free_list) abort();
+        pa->free_capacity = pa->num_pages;
+    }
+    if (pa->mode == PAGE_FREELIST_BITMAP) free_bitmap_init(&pa->free_bits, pa->num_pages);
     pa->free_count = 0;
+    atomic_init(&pa->lf_head, LF_NIL);
+    pthread_mutex_init(&pa->mutex, NULL);
+    if (!pa->lazy) segment_open(pa, 0);
 
-    for (size_t i = 0; i < pa->num_pages; ++i) {
-        pa->pages[i].base = pa->arena + i * pa->page_bytes;
-        pa->pages[i].ref  = 0;
-        pa->free_list[pa->free_count++] = &pa->pages[i];
+    pa->reclaim    = cfg->reclaim;
+    pa->advice     = cfg->reclaim_advice == RECLAIM_FREE ? MADV_FREE : MADV_DONTNEED;
+    // madvise wants the system page size (or the huge page size) on both
+    // ends, and a partly covered KV page would lose live data at the end
+    // the kernel rounds up: released ranges start and end on both.
+    size_t os_page = (size_t) sysconf(_SC_PAGESIZE);
+    if (pa->huge_page_bytes > os_page) os_page = pa->huge_page_bytes;
+    pa->reclaim_unit = pa->page_bytes / gcd(pa->page_bytes, os_page) * os_page;
+    size_t min_run = cfg->reclaim_min_run_bytes > 0 ? cfg->reclaim_min_run_bytes : HUGE_2MB;
+    if (min_run < pa->reclaim_unit) min_run = pa->reclaim_unit;
+    pa->min_run_pages = (min_run + pa->page_bytes - 1) / pa->page_bytes;
+    pa->high_water = cfg->reclaim_high_water;
+    if (pa->reclaim != RECLAIM_NONE) {
+        pa->released    = (Page**) malloc(pa->num_pages * sizeof(Page*));
+        pa->reclaim_buf = (Page**) malloc(pa->num_pages * sizeof(Page*));
+        pa->runs        = (ReclaimRun*) malloc(pa->num_pages * sizeof(ReclaimRun));
+        if (!pa->released || !pa->reclaim_buf || !pa->runs) abort();
+        free_bitmap_init(&pa->reclaim_marks, pa->num_pages);
     }
+    pa->num_released = 0;
+    pthread_mutex_init(&pa->released_lock, NULL);
+    pthread_mutex_init(&pa->reclaim_lock, NULL);
+    atomic_init(&pa->reclaiming, 0);
+    atomic_init(&pa->reclaim_left, 0);
 
-    pthread_mutex_init(&pa->mutex, NULL);
+    // A magazine would keep pages out of the bitmap and split its runs.
+    pa->mag_size = pa->mode == PAGE_FREELIST_BITMAP ? 0 : cfg->page_cache_pages;
+    if (pa->mag_size > 0 && pthread_key_create(&pa->mag_key, magazine_exit) != 0) abort();
+    pa->mags = NULL;
+    pthread_mutex_init(&pa->mags_lock, NULL);
+
+    atomic_init(&pa->in_use, 0);
+    atomic_init(&pa->peak_in_use, 0);
+    atomic_init(&pa->allocs, 0);
+    atomic_init(&pa->frees, 0);
+    atomic_init(&pa->failed_allocs, 0);
+    atomic_init(&pa->committed_free, 0);
+    atomic_init(&pa->reclaimed_pages, 0);
+    atomic_init(&pa->reclaim_calls, 0);
+    atomic_init(&pa->reclaim_failures, 0);
+    atomic_init(&pa->reclaim_reuses, 0);
     return pa;
 }
 
 void page_allocator_destroy(PageAllocator* pa) {
-    size_t arena_size = pa->num_pages * pa->page_bytes;
-    munmap(pa->arena, arena_size);
+    munmap(pa->arena, pa->map_bytes);
     free(pa->pages);
     free(pa->free_list);
+    if (pa->mode == PAGE_FREELIST_BITMAP) free_bitmap_destroy(&pa->free_bits);
     pthread_mutex_destroy(&pa->mutex);
+    pthread_mutex_destroy(&pa->grow_lock);
+    free(pa->released);
+    free(pa->reclaim_buf);
+    free(pa->runs);
+    if (pa->reclaim != RECLAIM_NONE) free_bitmap_destroy(&pa->reclaim_marks);
+    pthread_mutex_destroy(&pa->released_lock);
+    pthread_mutex_destroy(&pa->reclaim_lock);
+
+    // Deleting the key first means threads that still hold one of these
+    // magazines never run its destructor.
+    if (pa->mag_size > 0) pthread_key_delete(pa->mag_key);
+    PageMagazine* m = pa->mags;
+    while (m) {
+        PageMagazine* next = m->next;
+        magazine_free(m);
+        m = next;
+    }
+    pthread_mutex_destroy(&pa->mags_lock);
     free(pa);
 }
 
+void page_allocator_drain_cache(PageAllocator* pa) {
+    if (pa->mag_size == 0) return;
+    PageMagazine* m = (PageMagazine*) pthread_getspecific(pa->mag_key);
+    if (!m) return;
+    pthread_mutex_lock(&m->lock);
+    magazine_flush(pa, m, m->count);
+    pthread_mutex_unlock(&m->lock);
+}
+
+static void count_allocs(PageAllocator* pa, size_t n) {
+    atomic_fetch_add_explicit(&pa->allocs, n, memory_order_relaxed);
+    size_t used = atomic_fetch_add_explicit(&pa->in_use, n, memory_order_relaxed) + n;
+    size_t peak = atomic_load_explicit(&pa->peak_in_use, memory_order_relaxed);
+    while (used > peak &&
+           !atomic_compare_exchange_weak_explicit(&pa->peak_in_use, &peak, used,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed)) {
+    }
+}
+
 Page* page_alloc(PageAllocator* pa) {
-    pthread_mutex_lock(&pa->mutex);
-    if (pa->free_count == 0) {
-        pthread_mutex_unlock(&pa->mutex);
-        abort(); // out of pages in this simulation
+    Page* p;
+    return page_alloc_after(pa, NULL, &p, 1) ? p : NULL;
+}
+
+size_t page_alloc_n(PageAllocator* pa, Page** out, size_t n) {
+    return page_alloc_after(pa, NULL, out, n);
+}
+
+// Single pages go through the magazine, which refills itself; batches
+// drain it and go to the shared list for the rest.
+size_t page_alloc_after(PageAllocator* pa, const Page* after, Page** out, size_t n) {
+    if (n == 0) return 0;
+    size_t got;
+    if (pa->mag_size == 0) {
+        got = freelist_pop_n(pa, after, out, n);
+    } else if (n == 1) {
+        out[0] = magazine_alloc(pa);
+        got = out[0] != NULL;
+    } else {
+        got = magazine_alloc_n(pa, out, n);
     }
-    Page* p = pa->free_list[--pa->free_count];
-    p->ref = 1;
-    pthread_mutex_unlock(&pa->mutex);
-    return p;
+    if (got < n) atomic_fetch_add_explicit(&pa->failed_allocs, 1, memory_order_relaxed);
+
+    // Nobody else can see a page that is off the free list.
+    for (size_t i = 0; i < got; ++i) {
+        atomic_store_explicit(&out[i]->ref, 1, memory_order_relaxed);
+        out[i]->committed = 1;
+    }
+    if (got > 0) count_allocs(pa, got);
+    return got;
 }
 
+// The caller already holds a reference, which keeps the page off the free
+// list, so the increment itself needs no ordering.
 void page_inc_ref(PageAllocator* pa, Page* p) {
     (void) pa;
-    p->ref++;
+    unsigned int old = atomic_fetch_add_explicit(&p->ref, 1, memory_order_relaxed);
+    if (old == 0) abort(); // resurrecting a free page
+}
+
+// Release so our writes to the page happen before whoever frees it; the
+// thread that drops the last reference then acquires everyone else's.
+// Non-zero if that was the last reference.
+static int drop_ref(Page* p) {
+    unsigned int old = atomic_fetch_sub_explicit(&p->ref, 1, memory_order_release);
+    if (old == 0) abort();
+    if (old != 1) return 0;
+    atomic_thread_fence(memory_order_acquire);
+    return 1;
+}
+
+static void free_pages(PageAllocator* pa, Page** in, size_t n) {
+    atomic_fetch_add_explicit(&pa->frees, n, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&pa->in_use, n, memory_order_relaxed);
+
+    if (pa->mag_size > 0) {
+        magazine_free_n(pa, in, n);
+    } else {
+        freelist_push_n(pa, in, n);
+    }
 }
 
 void page_dec_ref(PageAllocator* pa, Page* p) {
-    pthread_mutex_lock(&pa->mutex);
-    if (p->ref == 0) {
-        pthread_mutex_unlock(&pa->mutex);
-        abort();
+    if (drop_ref(p)) free_pages(pa, &p, 1);
+}
+
+// The pages that went free are gathered first (on the stack for small
+// batches) and go back in one free_pages call: one lock, CAS or bitmap
+// update however large the batch.
+void page_free_n(PageAllocator* pa, Page** pages, size_t n) {
+    Page* local[LF_BATCH];
+    Page** freed = local;
+    if (n > LF_BATCH) {
+        freed = (Page**) malloc(n * sizeof(Page*));
+        if (!freed) abort();
     }
-    p->ref--;
-    if (p->ref == 0) {
-        pa->free_list[pa->free_count++] = p;
+    size_t count = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (drop_ref(pages[i])) freed[count++] = pages[i];
     }
-    pthread_mutex_unlock(&pa->mutex);
+    if (count > 0) free_pages(pa, freed, count);
+    if (freed != local) free(freed);
+}
+
+unsigned char* page_data(const Page* p) {
+    return p->base;
+}
+
+unsigned page_ref_count(const Page* p) {
+    return atomic_load_explicit(&((Page*) p)->ref, memory_order_acquire);
 }
 
 size_t page_allocator_pages_in_use(PageAllocator* pa) {
-    size_t used = 0;
-    pthread_mutex_lock(&pa->mutex);
-    for (size_t i = 0; i < pa->num_pages; ++i) {
-        if (pa->pages[i].ref > 0) used++;
-    }
-    pthread_mutex_unlock(&pa->mutex);
-    return used;
+    return atomic_load_explicit(&pa->in_use, memory_order_relaxed);
+}
+
+// Includes pages parked in magazines; an allocation can always reach them.
+size_t page_allocator_free_pages(PageAllocator* pa) {
+    size_t used = page_allocator_pages_in_use(pa);
+    return used < pa->num_pages ? pa->num_pages - used : 0;
+}
+
+PageAllocatorStats page_allocator_stats(PageAllocator* pa) {
+    PageAllocatorStats st;
+    size_t open = atomic_load_explicit(&pa->segments_open, memory_order_relaxed) * pa->seg_pages;
+    st.pages_total   = pa->num_pages;
+    st.pages_open    = open < pa->num_pages ? open : pa->num_pages;
+    st.pages_in_use  = atomic_load_explicit(&pa->in_use, memory_order_relaxed);
+    st.peak_in_use   = atomic_load_explicit(&pa->peak_in_use, memory_order_relaxed);
+    st.allocs        = atomic_load_explicit(&pa->allocs, memory_order_relaxed);
+    st.frees         = atomic_load_explicit(&pa->frees, memory_order_relaxed);
+    st.failed_allocs = atomic_load_explicit(&pa->failed_allocs, memory_order_relaxed);
+    st.committed_free  = atomic_load_explicit(&pa->committed_free, memory_order_relaxed);
+    st.reclaimed_pages = atomic_load_explicit(&pa->reclaimed_pages, memory_order_relaxed);
+    st.reclaim_calls   = atomic_load_explicit(&pa->reclaim_calls, memory_order_relaxed);
+    st.reclaim_failures = atomic_load_explicit(&pa->reclaim_failures, memory_order_relaxed);
+    st.reclaim_reuses  = atomic_load_explicit(&pa->reclaim_reuses, memory_order_relaxed);
+    return st;
+}
+
+void page_allocator_reclaim(PageAllocator* pa, size_t keep_pages) {
+    if (pa->reclaim == RECLAIM_NONE) return;
+    size_t committed = atomic_load_explicit(&pa->committed_free, memory_order_relaxed);
+    if (reclaim_due(pa, committed, keep_pages)) reclaim_to(pa, keep_pages, 1);
 }
 
 size_t page_allocator_page_bytes(PageAllocator* pa) {
     return pa->page_bytes;
 }
+
+size_t page_allocator_num_pages(PageAllocator* pa) {
+    return pa->num_pages;
+}
+
+ArenaPages page_allocator_arena_pages(PageAllocator* pa) {
+    return pa->backing;
+}
+
+size_t page_allocator_huge_page_bytes(PageAllocator* pa) {
+    return pa->huge_page_bytes;
+}
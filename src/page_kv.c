@@ -1,25 +1,59 @@
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
 #include "kv_backend.h"
 #include "sim_config.h"
 #include "page_alloc.h"
+#include "radix_cache.h"
+#include "hash_cache.h"
+#include "evict_pool.h"
+#include "seq_table.h"
 #include "workload.h"
 
 typedef struct PageSlot {
     Page* page;
+    uint64_t hash;           // PREFIX_CACHE_HASH: chained hash once full
+    EvictEntry* entry;       // set if the prefix cache holds this page too
 } PageSlot;
 
 typedef struct PagedSeqState {
     PageSlot* slots;
     size_t slots_capacity;
     size_t cur_tokens;
-    size_t shared_prefix_tokens;
+    size_t shared_prefix_tokens;   // from a group, the cache or a fork parent
+    size_t reserved_pages;   // private pages this sequence may still allocate
+
+    // Set while preempted: cur_tokens drops to the shared full pages and the
+    // private pages live in swap (PREEMPT_SWAP) or nowhere (PREEMPT_RECOMPUTE).
+    int preempted;
+    size_t preempted_tokens; // cur_tokens at preemption
+    unsigned char* swap;     // swap_pages * page_bytes, host memory
+    size_t swap_pages;
+
+    // Prefix cache modes: the leading cached_pages full pages have been
+    // offered to the cache; cache_node is the radix node of the last one.
+    SequenceWork work;
+    struct SharedPrefix* group;   // PREFIX_CACHE_GROUPS prefix it maps, if any
+    RadixNode* cache_node;
+    size_t cached_pages;
+    uint32_t* block;         // tokens_per_page scratch IDs
+    int live;                // between init/fork and finish
+
+    // SimConfig::sliding_window_tokens: slots is a ring indexed by page %
+    // ring_pages, and pages before first_page have slid out of the window.
+    // Radix nodes that slid out stay referenced from pinned up to the root:
+    // the cache cannot evict them under the nodes the sequence still maps.
+    size_t ring_pages;       // 0 => slots indexed by page
+    size_t first_page;
+    RadixNode* pinned;
 } PagedSeqState;
 
 typedef struct SharedPrefix {
+    EvictEntry entry;        // first, so pooled entries convert back
     Page** pages;
     size_t num_pages;
     size_t prefix_tokens;
+    size_t users;            // sequences mapping it; idle at zero
     int initialized;
 } SharedPrefix;
 
@@ -27,16 +61,41 @@ typedef struct PagedKVImpl {
     SimConfig cfg;
     PageAllocator* alloc;
 
-    PagedSeqState* seqs;
+    SeqTable seqs;           // of PagedSeqState; entries never move
     size_t num_seqs;
-    size_t seq_capacity;
+    SeqId* free_ids;         // finished ids, reused before num_seqs grows
+    size_t num_free;
 
     SharedPrefix* groups;    // size = cfg.num_groups
     size_t num_groups;
 
+    RadixCache* radix;       // PREFIX_CACHE_RADIX only
+    HashCache* hashes;       // PREFIX_CACHE_HASH only
+    EvictPool pool;          // idle groups / cache entries
+    size_t idle_cached_pages;   // held by the cache alone, so evictable
+    size_t prefix_hit_tokens;
+    size_t prefix_miss_tokens;
+    size_t evicted_pages;
+    size_t cow_pages;
+    size_t forks;
+    size_t truncated_pages;
+    size_t slid_pages;
+    size_t group_pages;      // pages held by built groups
+
+    size_t reserved_pages;   // sum of PagedSeqState::reserved_pages
+
+    size_t preemptions;
+    size_t swapped_out_bytes;
+    size_t swapped_in_bytes;
+    size_t recomputed_tokens;
+
     pthread_mutex_t mutex;
 } PagedKVImpl;
 
+static PagedSeqState* paged_seq(PagedKVImpl* impl, SeqId id) {
+    return (PagedSeqState*) seq_table_at(&impl->seqs, id);
+}
+
 static void paged_seq_reserve_slots(PagedSeqState* s, size_t n) {
     if (n <= s->slots_capacity) return;
     size_t new_cap = s->slots_capacity == 0 ? 4 : s->slots_capacity * 2;
@@ -45,32 +104,288 @@ static void paged_seq_reserve_slots(PagedSeqState* s, size_t n) {
     if (!ns) abort();
     for (size_t i = s->slots_capacity; i < new_cap; ++i) {
         ns[i].page = NULL;
+        ns[i].hash = HASH_CACHE_ROOT;
+        ns[i].entry = NULL;
     }
     s->slots = ns;
     s->slots_capacity = new_cap;
 }
 
-static SharedPrefix build_shared_prefix(PagedKVImpl* impl, size_t prefix_tokens) {
+static PageSlot* paged_slot(PagedSeqState* s, size_t page) {
+    return &s->slots[s->ring_pages ? page % s->ring_pages : page];
+}
+
+static int paged_has_cache(const PagedKVImpl* impl) {
+    return impl->radix != NULL || impl->hashes != NULL;
+}
+
+static void paged_drop_group(PagedKVImpl* impl, SharedPrefix* pref) {
+    page_free_n(impl->alloc, pref->pages, pref->num_pages);
+    free(pref->pages);
+    pref->pages = NULL;
+    impl->group_pages -= pref->num_pages;
+    pref->num_pages = 0;
+    pref->prefix_tokens = 0;
+    pref->initialized = 0;
+}
+
+// Reclaims idle cache pages in SimConfig::cache_evict order; returns how
+// many were freed. Caller holds impl->mutex.
+static size_t paged_cache_evict(PagedKVImpl* impl, size_t num_pages) {
+    size_t freed = 0;
+    EvictEntry* e;
+    while (freed < num_pages && (e = evict_pool_pop(&impl->pool)) != NULL) {
+        if (impl->radix) {
+            // Interior nodes are requeued once their last child is gone.
+            EvictEntry* parent;
+            if (!radix_cache_remove(impl->radix, e, &parent)) continue;
+            freed++;
+            if (parent && page_ref_count(radix_entry_page(parent)) == 1) {
+                evict_pool_requeue(&impl->pool, parent);
+            }
+        } else if (impl->hashes) {
+            hash_cache_remove(impl->hashes, e);
+            freed++;
+        } else {
+            SharedPrefix* pref = (SharedPrefix*) e;
+            freed += pref->num_pages;
+            paged_drop_group(impl, pref);
+        }
+    }
+    impl->idle_cached_pages -= freed < impl->idle_cached_pages ? freed : impl->idle_cached_pages;
+    impl->evicted_pages += freed;
+    return freed;
+}
+
+// The page before page_idx in s's block table, which new pages should
+// follow (page_alloc_after); NULL if it is not mapped.
+static const Page* paged_prev_page(PagedSeqState* s, size_t page_idx) {
+    if (page_idx == 0 || page_idx - 1 < s->first_page) return NULL;
+    if (!s->ring_pages && page_idx - 1 >= s->slots_capacity) return NULL;
+    return paged_slot(s, page_idx - 1)->page;
+}
+
+// Only evicts when the allocator is out of pages, so a warm cache never
+// costs a running sequence its memory. Caller holds impl->mutex.
+static Page* paged_page_alloc(PagedKVImpl* impl, const Page* after) {
+    Page* p;
+    while (page_alloc_after(impl->alloc, after, &p, 1) == 0) {
+        if (paged_cache_evict(impl, 1) == 0) return NULL;
+    }
+    return p;
+}
+
+// Batch form of paged_page_alloc: evicts for the shortfall only. Caller
+// holds impl->mutex.
+static size_t paged_page_alloc_n(PagedKVImpl* impl, const Page* after, Page** out, size_t n) {
+    size_t got = page_alloc_after(impl->alloc, after, out, n);
+    while (got < n && paged_cache_evict(impl, n - got) > 0) {
+        got += page_alloc_after(impl->alloc, got > 0 ? out[got - 1] : after, out + got, n - got);
+    }
+    return got;
+}
+
+// Drops the sequence's reference on a slot. Caller holds impl->mutex, which
+// also serializes every other change to a cached page's refcount.
+static void paged_release_slot(PagedKVImpl* impl, PageSlot* slot) {
+    page_dec_ref(impl->alloc, slot->page);
+    if (slot->entry && page_ref_count(slot->page) == 1) {
+        evict_pool_push(&impl->pool, slot->entry);
+        impl->idle_cached_pages++;
+    }
+    slot->page = NULL;
+    slot->hash = HASH_CACHE_ROOT;
+    slot->entry = NULL;
+}
+
+static void fill_block(uint32_t* block, const SequenceWork* work, size_t page, size_t per_page) {
+    for (size_t t = 0; t < per_page; ++t) {
+        block[t] = workload_token(work, page * per_page + t);
+    }
+}
+
+// Pages of the window plus the one being filled.
+static size_t paged_window_pages(const PagedKVImpl* impl) {
+    size_t per_page = impl->cfg.tokens_per_page;
+    return (impl->cfg.sliding_window_tokens + per_page - 1) / per_page + 1;
+}
+
+// Pages a sequence needs over its whole life. A sliding window lifts the
+// max_context_tokens bound.
+static size_t paged_total_pages(const PagedKVImpl* impl, const SequenceWork* work) {
+    size_t per_page = impl->cfg.tokens_per_page;
+    size_t tokens = work->prompt_tokens + work->gen_tokens;
+    if (impl->cfg.sliding_window_tokens == 0 && tokens > impl->cfg.max_context_tokens) {
+        tokens = impl->cfg.max_context_tokens;
+    }
+    return (tokens + per_page - 1) / per_page;
+}
+
+// Pages past the shared_full ones a sequence holds at once: past the
+// window, every new page replaces one that slid out. The radix nodes it
+// pinned before the first slide add up to another window.
+static size_t paged_private_need(const PagedKVImpl* impl, const SequenceWork* work,
+                                 size_t shared_full) {
+    size_t total = paged_total_pages(impl, work);
+    size_t need = total > shared_full ? total - shared_full : 0;
+    if (impl->cfg.sliding_window_tokens > 0) {
+        size_t bound = paged_window_pages(impl) * (impl->radix ? 2 : 1);
+        if (need > bound) need = bound;
+    }
+    return need;
+}
+
+// Offers s's full pages up to full_pages to the prefix cache. Radix callers
+// hold impl->mutex; the hash cache locks its own stripes, so the owning
+// thread may call this without it.
+static void paged_cache_pages(PagedKVImpl* impl, PagedSeqState* s, size_t full_pages) {
+    size_t per_page = impl->cfg.tokens_per_page;
+    for (; s->cached_pages < full_pages; ++s->cached_pages) {
+        // A page (or its parent) that slid out of the window is gone. Radix
+        // chains stop at the first slide, since slid nodes stay pinned.
+        if (s->first_page > 0 && (impl->radix || s->cached_pages <= s->first_page)) return;
+        PageSlot* slot = paged_slot(s, s->cached_pages);
+        fill_block(s->block, &s->work, s->cached_pages, per_page);
+        if (impl->radix) {
+            EvictEntry* adopted;
+            s->cache_node = radix_cache_insert(impl->radix, s->cache_node, s->block,
+                                               slot->page, &adopted);
+            // Someone cached these tokens first: map their page instead, so
+            // the node cache_node points at cannot be evicted under us.
+            EvictEntry* e = radix_node_entry(s->cache_node);
+            Page* cached = radix_entry_page(e);
+            if (!adopted && cached != slot->page) {
+                evict_pool_hit(&impl->pool, e);
+                if (page_ref_count(cached) == 1) impl->idle_cached_pages--;
+                page_inc_ref(impl->alloc, cached);
+                page_dec_ref(impl->alloc, slot->page);
+                slot->page = cached;
+            }
+            slot->entry = e;
+        } else {
+            uint64_t parent = s->cached_pages > 0 ? paged_slot(s, s->cached_pages - 1)->hash
+                                                  : HASH_CACHE_ROOT;
+            // Dropping a hash entry strands every page chained under it, so
+            // its rebuild cost counts the sequence's pages from here on.
+            size_t total = paged_total_pages(impl, &s->work);
+            slot->hash = hash_cache_block_hash(parent, s->block, per_page);
+            slot->entry = hash_cache_insert(impl->hashes, slot->hash, parent, s->block, slot->page,
+                                            total > s->cached_pages ? total - s->cached_pages : 1);
+        }
+    }
+}
+
+// Full pages of work's prompt (within the context window).
+static size_t prompt_full_pages(const PagedKVImpl* impl, const SequenceWork* work) {
+    size_t prompt = work->prompt_tokens;
+    if (prompt > impl->cfg.max_context_tokens) prompt = impl->cfg.max_context_tokens;
+    return prompt / impl->cfg.tokens_per_page;
+}
+
+// Longest cached run of work's full prompt pages. With s, the pages are
+// mapped into s's leading slots with references taken; without, it is a
+// lookup only and *idle (if non-NULL) counts the matched pages only the
+// cache holds. Caller holds impl->mutex.
+static size_t paged_cache_match(PagedKVImpl* impl, const SequenceWork* work, PagedSeqState* s,
+                                size_t* idle) {
+    size_t per_page = impl->cfg.tokens_per_page;
+    size_t num_pages = prompt_full_pages(impl, work);
+    size_t n = 0;
+    if (s) paged_seq_reserve_slots(s, num_pages);
+
+    if (impl->radix) {
+        uint32_t* tokens = (uint32_t*) calloc(num_pages * per_page + 1, sizeof(uint32_t));
+        EvictEntry** hit = s ? (EvictEntry**) malloc((num_pages + 1) * sizeof(EvictEntry*)) : NULL;
+        if (!tokens || (s && !hit)) abort();
+        for (size_t p = 0; p < num_pages; ++p) {
+            fill_block(tokens + p * per_page, work, p, per_page);
+        }
+        RadixNode* last;
+        n = radix_cache_match(impl->radix, tokens, num_pages, hit, &last);
+        if (s) s->cache_node = last;
+        for (RadixNode* node = last; !s && idle && node; node = radix_node_parent(node)) {
+            if (page_ref_count(radix_entry_page(radix_node_entry(node))) == 1) (*idle)++;
+        }
+        for (size_t i = 0; s && i < n; ++i) {
+            s->slots[i].page = radix_entry_page(hit[i]);
+            s->slots[i].entry = hit[i];
+        }
+        free(hit);
+        free(tokens);
+    } else {
+        uint32_t* block = (uint32_t*) malloc(per_page * sizeof(uint32_t));
+        if (!block) abort();
+        uint64_t parent = HASH_CACHE_ROOT;
+        for (; n < num_pages; ++n) {
+            fill_block(block, work, n, per_page);
+            uint64_t hash = hash_cache_block_hash(parent, block, per_page);
+            EvictEntry* e = hash_cache_lookup(impl->hashes, hash, parent, block, s != NULL);
+            if (!e) break;
+            if (!s && idle && page_ref_count(hash_entry_page(e)) == 1) (*idle)++;
+            if (s) {
+                s->slots[n].page = hash_entry_page(e);
+                s->slots[n].hash = hash;
+                s->slots[n].entry = e;
+            }
+            parent = hash;
+        }
+        free(block);
+    }
+
+    if (s) {
+        // A page only the cache held was idle until now.
+        for (size_t i = 0; i < n; ++i) {
+            evict_pool_hit(&impl->pool, s->slots[i].entry);
+            if (page_ref_count(s->slots[i].page) == 2) impl->idle_cached_pages--;
+        }
+        s->cached_pages = n;
+    }
+    return n;
+}
+
+// All or nothing: on failure no pages are held and *out is untouched.
+static KVStatus build_shared_prefix(PagedKVImpl* impl, size_t prefix_tokens, SharedPrefix* out) {
     SharedPrefix pref = {0};
-    if (prefix_tokens == 0) return pref;
+    if (prefix_tokens == 0) {
+        *out = pref;
+        return KV_OK;
+    }
     size_t tokens_per_page = impl->cfg.tokens_per_page;
     size_t pages_needed = (prefix_tokens + tokens_per_page - 1) / tokens_per_page;
 
     pref.pages = (Page**) malloc(pages_needed * sizeof(Page*));
+    if (!pref.pages) abort();
     pref.num_pages = pages_needed;
     pref.prefix_tokens = prefix_tokens;
     pref.initialized = 1;
+    evict_entry_init(&pref.entry, pages_needed);
 
-    for (size_t i = 0; i < pages_needed; ++i) {
-        pref.pages[i] = page_alloc(impl->alloc);
+    size_t got = paged_page_alloc_n(impl, NULL, pref.pages, pages_needed);
+    if (got < pages_needed) {
+        page_free_n(impl->alloc, pref.pages, got);
+        free(pref.pages);
+        return KV_ERR_NO_MEMORY;
+    }
+    if (impl->cfg.touch_kv) {
+        size_t bpt = bytes_per_token(&impl->cfg);
+        for (size_t i = 0; i < pages_needed; ++i) {
+            size_t tokens = prefix_tokens - i * tokens_per_page;
+            if (tokens > tokens_per_page) tokens = tokens_per_page;
+            memset(page_data(pref.pages[i]), (int) (i & 0xff), tokens * bpt);
+        }
     }
-    return pref;
+    impl->group_pages += pages_needed;
+    *out = pref;
+    return KV_OK;
 }
 
-static size_t shareable_tokens(const PagedKVImpl* impl, size_t tokens) {
-    size_t per_page = impl->cfg.tokens_per_page;
-    if (per_page == 0) return 0;
-    return (tokens / per_page) * per_page;
+// Group prefixes may end mid-page: the partial last page is shared as well
+// and copied on the first append past the prefix.
+static size_t shareable_tokens(const PagedKVImpl* impl, const SequenceWork* work) {
+    if (work->shared_prompt_id < 0) return 0;
+    size_t tokens = work->shared_prompt_tokens;
+    if (tokens > impl->cfg.max_context_tokens) tokens = impl->cfg.max_context_tokens;
+    return tokens;
 }
 
 // call after impl is created
@@ -83,45 +398,161 @@ static void paged_init_prefix_groups(PagedKVImpl* impl) {
     impl->groups = (SharedPrefix*) calloc(impl->num_groups, sizeof(SharedPrefix));
 }
 
-static SeqId paged_init_sequence(KVBackend* backend, const SequenceWork* work) {
-    PagedKVImpl* impl = (PagedKVImpl*) backend->impl;
-    pthread_mutex_lock(&impl->mutex);
+// Reserves the pages s may still allocate: everything past its shared full
+// pages, including a copy of a partially filled shared page. Caller holds
+// impl->mutex.
+static void paged_seq_reserve(PagedKVImpl* impl, PagedSeqState* s) {
+    size_t shared_full = s->shared_prefix_tokens / impl->cfg.tokens_per_page;
+    s->reserved_pages = paged_private_need(impl, &s->work, shared_full);
+    impl->reserved_pages += s->reserved_pages;
+}
 
-    if (impl->num_seqs == impl->seq_capacity) {
-        size_t new_cap = impl->seq_capacity == 0 ? 16 : impl->seq_capacity * 2;
-        PagedSeqState* ns = (PagedSeqState*) realloc(impl->seqs, new_cap * sizeof(PagedSeqState));
-        if (!ns) {
-            pthread_mutex_unlock(&impl->mutex);
-            abort();
-        }
-        for (size_t i = impl->seq_capacity; i < new_cap; ++i) {
-            ns[i].slots = NULL;
-            ns[i].slots_capacity = 0;
-            ns[i].cur_tokens = 0;
-            ns[i].shared_prefix_tokens = 0;
-        }
-        impl->seqs = ns;
-        impl->seq_capacity = new_cap;
+// Claims a sequence id, recycling finished ones first so fork/finish churn
+// does not grow the table. Caller holds impl->mutex.
+static SeqId paged_new_seq(PagedKVImpl* impl) {
+    if (impl->num_free == 0 && impl->num_seqs == impl->seqs.capacity) {
+        // Running sequences keep appending while the table grows.
+        seq_table_reserve(&impl->seqs, impl->num_seqs + 1);
+        SeqId* nf = (SeqId*) realloc(impl->free_ids, impl->seqs.capacity * sizeof(SeqId));
+        if (!nf) abort();
+        impl->free_ids = nf;
     }
-
-    SeqId id = impl->num_seqs++;
-    PagedSeqState* s = &impl->seqs[id];
+    SeqId id = impl->num_free > 0 ? impl->free_ids[--impl->num_free] : impl->num_seqs++;
+    PagedSeqState* s = paged_seq(impl, id);
+    s->live = 1;
     s->cur_tokens = 0;
     s->shared_prefix_tokens = 0;
+    s->reserved_pages = 0;
+    s->group = NULL;
+    s->cache_node = NULL;
+    s->cached_pages = 0;
+    s->ring_pages = 0;
+    s->first_page = 0;
+    s->pinned = NULL;
+    return id;
+}
 
-    const int shared_id = work->shared_prompt_id;
-    size_t shared_tokens = (shared_id >= 0) ? shareable_tokens(impl, work->shared_prompt_tokens) : 0;
+// Turns s's slots into a ring for the sliding window, big enough for the
+// prefix pages mapped at init if those do not fit the window. Caller holds
+// impl->mutex.
+static void paged_seq_ring(PagedKVImpl* impl, PagedSeqState* s, size_t mapped_pages) {
+    if (impl->cfg.sliding_window_tokens == 0) return;
+    size_t ring = paged_window_pages(impl);
+    if (ring < mapped_pages) ring = mapped_pages;
+    paged_seq_reserve_slots(s, ring);
+    s->ring_pages = ring;
+}
+
+// Releases the pages whose tokens have all slid out of the window. Caller
+// holds impl->mutex.
+static void paged_slide_window(PagedKVImpl* impl, PagedSeqState* s) {
+    size_t per_page = impl->cfg.tokens_per_page;
+    size_t window = impl->cfg.sliding_window_tokens;
+    while ((s->first_page + 1) * per_page + window <= s->cur_tokens) {
+        PageSlot* slot = paged_slot(s, s->first_page++);
+        if (!slot->page) continue;
+        if (impl->radix && slot->entry) {
+            s->pinned = radix_entry_node(slot->entry);
+            *slot = (PageSlot){ NULL, HASH_CACHE_ROOT, NULL };
+        } else {
+            paged_release_slot(impl, slot);
+        }
+        impl->slid_pages++;
+    }
+}
+
+// Drops the references paged_slide_window kept, deepest first. Caller holds
+// impl->mutex.
+static void paged_release_pinned(PagedKVImpl* impl, PagedSeqState* s) {
+    for (RadixNode* n = s->pinned; n; n = radix_node_parent(n)) {
+        EvictEntry* e = radix_node_entry(n);
+        PageSlot slot = { radix_entry_page(e), HASH_CACHE_ROOT, e };
+        paged_release_slot(impl, &slot);
+    }
+    s->pinned = NULL;
+}
+
+// First page preemption gives up: past the shared full pages and the ones
+// that slid out.
+static size_t paged_private_first(const PagedKVImpl* impl, const PagedSeqState* s) {
+    size_t first = s->shared_prefix_tokens / impl->cfg.tokens_per_page;
+    return first > s->first_page ? first : s->first_page;
+}
 
-    if (shared_tokens > 0 && impl->num_groups > 0) {
-        size_t gid = (size_t) shared_id % impl->num_groups;
-        SharedPrefix* pref = &impl->groups[gid];
-        if (!pref->initialized) {
-            *pref = build_shared_prefix(impl, shared_tokens);
+// Pages a sequence needs over its whole life, split into the shared prefix
+// and the private tail. A partially filled shared page counts as private,
+// since the sequence copies it before writing. *claimed is how many prefix
+// pages admitting it would allocate or take out of the idle pool: a group
+// that is not built or idle, or cached pages no one else maps.
+static size_t paged_private_pages(PagedKVImpl* impl, const SequenceWork* work, size_t* claimed) {
+    size_t per_page = impl->cfg.tokens_per_page;
+    size_t shared_full = 0;
+
+    *claimed = 0;
+    if (paged_has_cache(impl)) {
+        shared_full = paged_cache_match(impl, work, NULL, claimed);
+    } else if (shareable_tokens(impl, work) > 0 && impl->num_groups > 0) {
+        const SharedPrefix* pref = &impl->groups[(size_t) work->shared_prompt_id % impl->num_groups];
+        size_t shared_tokens = pref->initialized ? pref->prefix_tokens : shareable_tokens(impl, work);
+        if (!pref->initialized || pref->users == 0) {
+            *claimed = (shared_tokens + per_page - 1) / per_page;
         }
-        if (pref->prefix_tokens != shared_tokens) {
-            shared_tokens = pref->prefix_tokens;
+        shared_full = shared_tokens / per_page;
+    }
+    return paged_private_need(impl, work, shared_full);
+}
+
+static int paged_can_admit(KVBackend* backend, const SequenceWork* work) {
+    PagedKVImpl* impl = (PagedKVImpl*) backend->impl;
+    pthread_mutex_lock(&impl->mutex);
+    size_t claimed;
+    size_t need = paged_private_pages(impl, work, &claimed);
+    need += claimed;
+    size_t avail = page_allocator_free_pages(impl->alloc);
+    avail += impl->idle_cached_pages;
+    int ok = need + impl->reserved_pages <= avail;
+    pthread_mutex_unlock(&impl->mutex);
+    return ok;
+}
+
+static KVStatus paged_init_sequence(KVBackend* backend, const SequenceWork* work, SeqId* out) {
+    PagedKVImpl* impl = (PagedKVImpl*) backend->impl;
+    pthread_mutex_lock(&impl->mutex);
+
+    // Build the group prefix before claiming an id so a failure leaves
+    // nothing behind.
+    const int shared_id = work->shared_prompt_id;
+    size_t shared_tokens = shareable_tokens(impl, work);
+    SharedPrefix* pref = NULL;
+    size_t hit_tokens = 0;
+    if (!paged_has_cache(impl) && shared_tokens > 0 && impl->num_groups > 0) {
+        pref = &impl->groups[(size_t) shared_id % impl->num_groups];
+        if (pref->initialized) {
+            hit_tokens = pref->prefix_tokens;
+            evict_pool_hit(&impl->pool, &pref->entry);
+            if (pref->users == 0) impl->idle_cached_pages -= pref->num_pages;
+        } else if (build_shared_prefix(impl, shared_tokens, pref) != KV_OK) {
+            pthread_mutex_unlock(&impl->mutex);
+            return KV_ERR_NO_MEMORY;
         }
-        size_t prefix_pages = pref->num_pages;
+        pref->users++;
+        shared_tokens = pref->prefix_tokens;
+    }
+
+    SeqId id = paged_new_seq(impl);
+    PagedSeqState* s = paged_seq(impl, id);
+    s->work = *work;
+    s->group = pref;
+
+    size_t prefix_pages = 0;
+    if (paged_has_cache(impl)) {
+        s->block = (uint32_t*) malloc(impl->cfg.tokens_per_page * sizeof(uint32_t));
+        if (!s->block) abort();
+        prefix_pages = paged_cache_match(impl, work, s, NULL);
+        s->shared_prefix_tokens = prefix_pages * impl->cfg.tokens_per_page;
+        hit_tokens = s->shared_prefix_tokens;
+    } else if (pref) {
+        prefix_pages = pref->num_pages;
         paged_seq_reserve_slots(s, prefix_pages);
         for (size_t i = 0; i < prefix_pages; ++i) {
             Page* p = pref->pages[i];
@@ -130,88 +561,489 @@ static SeqId paged_init_sequence(KVBackend* backend, const SequenceWork* work) {
         }
         s->shared_prefix_tokens = shared_tokens;
     }
+    paged_seq_ring(impl, s, prefix_pages);
+    impl->prefix_hit_tokens += hit_tokens;
+    impl->prefix_miss_tokens += work->prompt_tokens > hit_tokens ? work->prompt_tokens - hit_tokens : 0;
+
+    paged_seq_reserve(impl, s);
 
     pthread_mutex_unlock(&impl->mutex);
-    return id;
+    *out = id;
+    return KV_OK;
+}
+
+// Gives s a private copy of a page it shares. Caller holds impl->mutex.
+static KVStatus paged_cow_slot(PagedKVImpl* impl, PagedSeqState* s, size_t page_idx) {
+    PageSlot* slot = paged_slot(s, page_idx);
+    if (page_ref_count(slot->page) == 1) return KV_OK;   // the others let go
+    Page* p = paged_page_alloc(impl, paged_prev_page(s, page_idx));
+    if (!p) return KV_ERR_NO_MEMORY;
+    memcpy(page_data(p), page_data(slot->page), page_allocator_page_bytes(impl->alloc));
+    paged_release_slot(impl, slot);
+    slot->page = p;
+    if (s->reserved_pages > 0) {
+        s->reserved_pages--;
+        impl->reserved_pages--;
+    }
+    impl->cow_pages++;
+    return KV_OK;
 }
 
-static void paged_append_token(KVBackend* backend, SeqId id) {
+// SimConfig::touch_kv: fills tokens [from, to) of s with K/V bytes, one run
+// per page. Tokens of the shared prefix are already on their pages, written
+// by whoever built them; the rest are on private pages by now.
+static void paged_write_tokens(PagedKVImpl* impl, PagedSeqState* s, size_t from, size_t to) {
+    if (!impl->cfg.touch_kv) return;
+    size_t per_page = impl->cfg.tokens_per_page;
+    size_t bpt = bytes_per_token(&impl->cfg);
+    if (from < s->shared_prefix_tokens) from = s->shared_prefix_tokens;
+    while (from < to) {
+        size_t page_idx = from / per_page;
+        size_t stop = (page_idx + 1) * per_page;
+        if (stop > to) stop = to;
+        memset(page_data(paged_slot(s, page_idx)->page) + (from % per_page) * bpt,
+               (int) (page_idx & 0xff), (stop - from) * bpt);
+        from = stop;
+    }
+}
+
+static KVStatus paged_append_token(KVBackend* backend, SeqId id) {
     PagedKVImpl* impl = (PagedKVImpl*) backend->impl;
-    PagedSeqState* s = &impl->seqs[id];
+    PagedSeqState* s = paged_seq(impl, id);
 
-    if (s->cur_tokens >= impl->cfg.max_context_tokens) {
-        return;
+    size_t window = impl->cfg.sliding_window_tokens;
+    if (window == 0 && s->cur_tokens >= impl->cfg.max_context_tokens) {
+        return KV_OK;
     }
 
     size_t idx = s->cur_tokens;
     size_t tokens_per_page = impl->cfg.tokens_per_page;
     size_t page_idx = idx / tokens_per_page;
+    int mapped = (s->ring_pages || page_idx < s->slots_capacity) && paged_slot(s, page_idx)->page;
 
-    if (page_idx >= s->slots_capacity || s->slots[page_idx].page == NULL) {
+    // Appends within a mapped page take no lock. Opening, copying or sliding
+    // past a page does: an allocation that comes up short evicts idle cache
+    // pages, and the prefix cache and reserved_pages are shared.
+    if (!mapped) {
+        if (impl->hashes) paged_cache_pages(impl, s, page_idx);
         pthread_mutex_lock(&impl->mutex);
-        if (page_idx >= s->slots_capacity) {
+        if (!s->ring_pages && page_idx >= s->slots_capacity) {
             paged_seq_reserve_slots(s, page_idx + 1);
         }
-        if (s->slots[page_idx].page == NULL) {
-            s->slots[page_idx].page = page_alloc(impl->alloc);
+        if (impl->radix) paged_cache_pages(impl, s, page_idx);
+        PageSlot* slot = paged_slot(s, page_idx);
+        if (slot->page == NULL) {
+            Page* p = paged_page_alloc(impl, paged_prev_page(s, page_idx));
+            if (!p) {
+                pthread_mutex_unlock(&impl->mutex);
+                return KV_ERR_NO_MEMORY;
+            }
+            slot->page = p;
+            if (s->reserved_pages > 0) {
+                s->reserved_pages--;
+                impl->reserved_pages--;
+            }
         }
         pthread_mutex_unlock(&impl->mutex);
+    } else if (idx >= s->shared_prefix_tokens && page_ref_count(paged_slot(s, page_idx)->page) > 1) {
+        // First write past the shared tokens of a page someone else maps.
+        pthread_mutex_lock(&impl->mutex);
+        KVStatus st = paged_cow_slot(impl, s, page_idx);
+        pthread_mutex_unlock(&impl->mutex);
+        if (st != KV_OK) return st;
     }
 
+    paged_write_tokens(impl, s, idx, idx + 1);
     s->cur_tokens = idx + 1;
+    if (window > 0 && (s->first_page + 1) * tokens_per_page + window <= s->cur_tokens) {
+        pthread_mutex_lock(&impl->mutex);
+        paged_slide_window(impl, s);
+        pthread_mutex_unlock(&impl->mutex);
+    }
+    return KV_OK;
 }
 
-static void paged_finish_sequence(KVBackend* backend, SeqId id) {
+// Tokens on pages already mapped (the partial tail, or prefix pages mapped
+// at init) take paged_append_token's path once per page, which copies a
+// shared page before the first write past the shared tokens. The pages for
+// the rest come from the allocator in batches under one lock.
+static KVStatus paged_append_tokens(KVBackend* backend, SeqId id, size_t n, size_t* appended) {
     PagedKVImpl* impl = (PagedKVImpl*) backend->impl;
-    if (id >= impl->num_seqs) return;
-    PagedSeqState* s = &impl->seqs[id];
+    PagedSeqState* s = paged_seq(impl, id);
+    size_t per_page = impl->cfg.tokens_per_page;
+    size_t start = s->cur_tokens;
+    KVStatus st = KV_OK;
+
+    if (impl->cfg.sliding_window_tokens > 0) {
+        // The ring only has room for the window: slide as the tokens go in.
+        size_t done = 0;
+        while (done < n && (st = paged_append_token(backend, id)) == KV_OK) done++;
+        if (appended) *appended = done;
+        return st;
+    }
+
+    // Tokens past max_context_tokens are dropped, as one at a time.
+    size_t end = start + n;
+    size_t cap = impl->cfg.max_context_tokens > start ? impl->cfg.max_context_tokens : start;
+    if (end > cap) end = cap;
+
+    while (s->cur_tokens < end) {
+        size_t page_idx = s->cur_tokens / per_page;
+        if (page_idx >= s->slots_capacity || !s->slots[page_idx].page) break;
+        size_t stop = (page_idx + 1) * per_page;
+        if (s->cur_tokens < s->shared_prefix_tokens && s->shared_prefix_tokens < stop) {
+            stop = s->shared_prefix_tokens;
+        }
+        if (stop > end) stop = end;
+        st = paged_append_token(backend, id);
+        if (st != KV_OK) break;
+        paged_write_tokens(impl, s, s->cur_tokens, stop);
+        s->cur_tokens = stop;
+    }
+
+    if (st == KV_OK && s->cur_tokens < end) {
+        size_t first = s->cur_tokens / per_page;
+        size_t last = (end - 1) / per_page;
+        size_t mapped = first;
+        if (impl->hashes) paged_cache_pages(impl, s, first);
+        pthread_mutex_lock(&impl->mutex);
+        paged_seq_reserve_slots(s, last + 1);
+        if (impl->radix) paged_cache_pages(impl, s, first);
+        while (mapped <= last) {
+            Page* batch[64];
+            size_t want = last + 1 - mapped;
+            if (want > 64) want = 64;
+            size_t got = paged_page_alloc_n(impl, paged_prev_page(s, mapped), batch, want);
+            for (size_t i = 0; i < got; ++i) s->slots[mapped + i].page = batch[i];
+            mapped += got;
+            if (got < want) break;
+        }
+        size_t used = mapped - first;
+        if (used > s->reserved_pages) used = s->reserved_pages;
+        s->reserved_pages -= used;
+        impl->reserved_pages -= used;
+        pthread_mutex_unlock(&impl->mutex);
 
+        if (mapped * per_page < end) {
+            end = mapped * per_page;
+            st = KV_ERR_NO_MEMORY;
+        }
+        paged_write_tokens(impl, s, s->cur_tokens, end);
+        s->cur_tokens = end;
+    }
+
+    if (appended) *appended = st == KV_OK ? n : s->cur_tokens - start;
+    return st;
+}
+
+static void paged_finish_sequence(KVBackend* backend, SeqId id) {
+    PagedKVImpl* impl = (PagedKVImpl*) backend->impl;
     pthread_mutex_lock(&impl->mutex);
-    for (size_t i = 0; i < s->slots_capacity; ++i) {
-        if (s->slots[i].page) {
-            page_dec_ref(impl->alloc, s->slots[i].page);
-            s->slots[i].page = NULL;
+    if (id >= impl->num_seqs || !paged_seq(impl, id)->live) {
+        pthread_mutex_unlock(&impl->mutex);
+        return;
+    }
+    PagedSeqState* s = paged_seq(impl, id);
+    if (paged_has_cache(impl) && !s->preempted) {
+        paged_cache_pages(impl, s, s->cur_tokens / impl->cfg.tokens_per_page);
+    }
+    // Tail first, so the deepest cached pages are the first to go idle.
+    // Uncached pages go back to the allocator in batches.
+    Page* batch[64];
+    size_t count = 0;
+    for (size_t i = s->slots_capacity; i-- > 0;) {
+        PageSlot* slot = &s->slots[i];
+        if (!slot->page) continue;
+        if (slot->entry) {
+            paged_release_slot(impl, slot);
+            continue;
+        }
+        batch[count++] = slot->page;
+        slot->page = NULL;
+        slot->hash = HASH_CACHE_ROOT;
+        if (count == 64) {
+            page_free_n(impl->alloc, batch, count);
+            count = 0;
         }
     }
+    page_free_n(impl->alloc, batch, count);
+    paged_release_pinned(impl, s);
+    if (s->group && --s->group->users == 0) {
+        evict_pool_push(&impl->pool, &s->group->entry);
+        impl->idle_cached_pages += s->group->num_pages;
+    }
+    s->group = NULL;
     s->cur_tokens = 0;
     s->shared_prefix_tokens = 0;
+    impl->reserved_pages -= s->reserved_pages;
+    s->reserved_pages = 0;
+    free(s->swap);
+    s->swap = NULL;
+    s->swap_pages = 0;
+    s->preempted = 0;
+    s->cache_node = NULL;
+    s->cached_pages = 0;
+    free(s->block);
+    s->block = NULL;
+    s->live = 0;
+    impl->free_ids[impl->num_free++] = id;
+    pthread_mutex_unlock(&impl->mutex);
+
+    // Sequences usually finish on the scheduler thread while decode workers
+    // allocate; hand the freed pages back in one batch.
+    page_allocator_drain_cache(impl->alloc);
+    if (impl->cfg.reclaim == RECLAIM_ON_FINISH) {
+        page_allocator_reclaim(impl->alloc, impl->cfg.reclaim_keep_pages);
+    }
+}
+
+// Pages past the last kept token go back to the allocator, or stay cached.
+// The caller is about to append again, so they stay in this thread's page
+// magazine rather than being drained. Tokens that slid out of the window
+// cannot come back, so new_len stops at the first resident page.
+static void paged_truncate_sequence(KVBackend* backend, SeqId id, size_t new_len) {
+    PagedKVImpl* impl = (PagedKVImpl*) backend->impl;
+    PagedSeqState* s = paged_seq(impl, id);
+    size_t per_page = impl->cfg.tokens_per_page;
+
+    pthread_mutex_lock(&impl->mutex);
+    if (new_len < s->first_page * per_page) new_len = s->first_page * per_page;
+    if (new_len >= s->cur_tokens || s->preempted) {
+        pthread_mutex_unlock(&impl->mutex);
+        return;
+    }
+    size_t keep = (new_len + per_page - 1) / per_page;
+    size_t mapped = s->cur_tokens > s->shared_prefix_tokens ? s->cur_tokens : s->shared_prefix_tokens;
+    size_t released = 0;
+    for (size_t i = (mapped + per_page - 1) / per_page; i-- > keep;) {
+        PageSlot* slot = paged_slot(s, i);
+        if (!slot->page) continue;
+        paged_release_slot(impl, slot);
+        released++;
+    }
+    // The kept partial page may be shared or cached; the next append
+    // copies it first.
+    if (s->shared_prefix_tokens > new_len) s->shared_prefix_tokens = new_len;
+    while (s->cached_pages > new_len / per_page) {
+        if (impl->radix) s->cache_node = radix_node_parent(s->cache_node);
+        s->cached_pages--;
+    }
+    s->reserved_pages += released;
+    impl->reserved_pages += released;
+    impl->truncated_pages += released;
+    s->cur_tokens = new_len;
+    pthread_mutex_unlock(&impl->mutex);
+}
+
+// Private pages are the ones past the shared prefix's full pages.
+static void paged_preempt_sequence(KVBackend* backend, SeqId id) {
+    PagedKVImpl* impl = (PagedKVImpl*) backend->impl;
+    PagedSeqState* s = paged_seq(impl, id);
+    size_t per_page = impl->cfg.tokens_per_page;
+    size_t page_bytes = page_allocator_page_bytes(impl->alloc);
+
+    pthread_mutex_lock(&impl->mutex);
+    if (s->preempted) {
+        pthread_mutex_unlock(&impl->mutex);
+        return;
+    }
+    // A partially filled shared page goes too: it is shared copy-on-write,
+    // so the sequence may already hold its own copy.
+    size_t first = paged_private_first(impl, s);
+    size_t keep = first * per_page;
+    size_t mapped = s->cur_tokens > s->shared_prefix_tokens ? s->cur_tokens : s->shared_prefix_tokens;
+    size_t end = (mapped + per_page - 1) / per_page;
+    size_t n = end > first ? end - first : 0;
+
+    if (impl->cfg.preempt_mode == PREEMPT_SWAP && n > 0) {
+        s->swap = (unsigned char*) malloc(n * page_bytes);
+        if (!s->swap) abort();
+        for (size_t i = 0; i < n; ++i) {
+            memcpy(s->swap + i * page_bytes, page_data(paged_slot(s, first + i)->page), page_bytes);
+        }
+        s->swap_pages = n;
+        impl->swapped_out_bytes += n * page_bytes;
+    } else {
+        impl->recomputed_tokens += s->cur_tokens > keep ? s->cur_tokens - keep : 0;
+    }
+    for (size_t i = end; i-- > first;) {
+        paged_release_slot(impl, paged_slot(s, i));
+    }
+    // Pages past `first` get offered to the cache again as they come back.
+    while (s->cached_pages > first) {
+        if (impl->radix) s->cache_node = radix_node_parent(s->cache_node);
+        s->cached_pages--;
+    }
+    // The pages come back on resume or re-append; keep admission honest.
+    s->reserved_pages += n;
+    impl->reserved_pages += n;
+
+    s->preempted = 1;
+    s->preempted_tokens = s->cur_tokens;
+    if (s->cur_tokens > keep) s->cur_tokens = keep;
+    impl->preemptions++;
+    pthread_mutex_unlock(&impl->mutex);
+
+    page_allocator_drain_cache(impl->alloc);
+}
+
+static KVStatus paged_resume_sequence(KVBackend* backend, SeqId id, size_t* recompute) {
+    PagedKVImpl* impl = (PagedKVImpl*) backend->impl;
+    PagedSeqState* s = paged_seq(impl, id);
+    size_t page_bytes = page_allocator_page_bytes(impl->alloc);
+
+    pthread_mutex_lock(&impl->mutex);
+    if (!s->preempted) {
+        pthread_mutex_unlock(&impl->mutex);
+        *recompute = 0;
+        return KV_OK;
+    }
+    if (s->swap) {
+        size_t first = paged_private_first(impl, s);
+        size_t n = s->swap_pages;
+        for (size_t i = 0; i < n; ++i) {
+            Page* p = paged_page_alloc(impl, paged_prev_page(s, first + i));
+            if (!p) {
+                while (i-- > 0) {
+                    paged_release_slot(impl, paged_slot(s, first + i));
+                }
+                pthread_mutex_unlock(&impl->mutex);
+                return KV_ERR_NO_MEMORY;
+            }
+            paged_slot(s, first + i)->page = p;
+            memcpy(page_data(p), s->swap + i * page_bytes, page_bytes);
+        }
+        free(s->swap);
+        s->swap = NULL;
+        s->swap_pages = 0;
+        s->reserved_pages -= n;
+        impl->reserved_pages -= n;
+        impl->swapped_in_bytes += n * page_bytes;
+        s->cur_tokens = s->preempted_tokens;
+    }
+    *recompute = s->preempted_tokens - s->cur_tokens;
+    s->preempted = 0;
+    pthread_mutex_unlock(&impl->mutex);
+    return KV_OK;
+}
+
+// The child maps every page of parent, so they share the history copy-on-
+// write; its shared prefix is the whole history at the fork. Like
+// paged_can_admit, refuses a child whose reservation (plus the parent's
+// copy of its partial last page) does not fit in the free and idle cached
+// pages left after everyone else's.
+static KVStatus paged_fork_sequence(KVBackend* backend, SeqId parent, const SequenceWork* work,
+                                    SeqId* out) {
+    PagedKVImpl* impl = (PagedKVImpl*) backend->impl;
+    size_t per_page = impl->cfg.tokens_per_page;
+    pthread_mutex_lock(&impl->mutex);
+
+    PagedSeqState* p = paged_seq(impl, parent);
+    size_t need = paged_private_need(impl, work ? work : &p->work, p->cur_tokens / per_page);
+    need += p->cur_tokens % per_page != 0;
+    size_t avail = page_allocator_free_pages(impl->alloc) + impl->idle_cached_pages;
+    if (need + impl->reserved_pages > avail) {
+        pthread_mutex_unlock(&impl->mutex);
+        return KV_ERR_NO_MEMORY;
+    }
+
+    SeqId id = paged_new_seq(impl);
+    PagedSeqState* s = paged_seq(impl, id);
+    size_t n = (p->cur_tokens + per_page - 1) / per_page;
+
+    s->work = work ? *work : p->work;
+    s->ring_pages = p->ring_pages;
+    s->first_page = p->first_page;
+    paged_seq_reserve_slots(s, s->ring_pages ? s->ring_pages : n);
+    for (size_t i = s->first_page; i < n; ++i) {
+        PageSlot* slot = paged_slot(s, i);
+        *slot = *paged_slot(p, i);
+        page_inc_ref(impl->alloc, slot->page);
+    }
+    s->pinned = p->pinned;
+    for (RadixNode* node = s->pinned; node; node = radix_node_parent(node)) {
+        page_inc_ref(impl->alloc, radix_entry_page(radix_node_entry(node)));
+    }
+    s->cur_tokens = p->cur_tokens;
+    s->shared_prefix_tokens = p->cur_tokens;
+    s->group = p->group;
+    if (s->group) s->group->users++;
+    s->cache_node = p->cache_node;
+    s->cached_pages = p->cached_pages;
+    if (paged_has_cache(impl)) {
+        s->block = (uint32_t*) malloc(per_page * sizeof(uint32_t));
+        if (!s->block) abort();
+    }
+    paged_seq_reserve(impl, s);
+
+    // The parent now has to copy its partial last page as well.
+    if (p->cur_tokens % per_page != 0) {
+        p->reserved_pages++;
+        impl->reserved_pages++;
+    }
+    impl->forks++;
     pthread_mutex_unlock(&impl->mutex);
+    *out = id;
+    return KV_OK;
 }
 
 static KVStats paged_stats(KVBackend* backend) {
     PagedKVImpl* impl = (PagedKVImpl*) backend->impl;
-    KVStats st = (KVStats){0, 0, 0};
+    KVStats st = (KVStats){0, 0, 0, 0};
 
+    // With a sliding window only the last window tokens are attended to.
+    size_t window = impl->cfg.sliding_window_tokens;
     pthread_mutex_lock(&impl->mutex);
     for (size_t i = 0; i < impl->num_seqs; ++i) {
-        st.logical_tokens += impl->seqs[i].cur_tokens;
+        size_t tokens = paged_seq(impl, i)->cur_tokens;
+        st.logical_tokens += window > 0 && tokens > window ? window : tokens;
     }
     pthread_mutex_unlock(&impl->mutex);
 
     st.logical_bytes = st.logical_tokens * bytes_per_token(&impl->cfg);
     size_t pages_in_use = page_allocator_pages_in_use(impl->alloc);
     st.physical_bytes = pages_in_use * page_allocator_page_bytes(impl->alloc);
+    st.capacity_bytes = page_allocator_num_pages(impl->alloc) * page_allocator_page_bytes(impl->alloc);
     return st;
 }
 
+static void paged_counters(KVBackend* backend, KVCounters* out) {
+    PagedKVImpl* impl = (PagedKVImpl*) backend->impl;
+    out->alloc = page_allocator_stats(impl->alloc);
+    pthread_mutex_lock(&impl->mutex);
+    out->preemptions       = impl->preemptions;
+    out->swapped_out_bytes = impl->swapped_out_bytes;
+    out->swapped_in_bytes  = impl->swapped_in_bytes;
+    out->recomputed_tokens = impl->recomputed_tokens;
+    out->prefix_hit_tokens  = impl->prefix_hit_tokens;
+    out->prefix_miss_tokens = impl->prefix_miss_tokens;
+    out->evicted_pages      = impl->evicted_pages;
+    out->cow_pages          = impl->cow_pages;
+    out->forks              = impl->forks;
+    out->truncated_pages    = impl->truncated_pages;
+    out->slid_pages         = impl->slid_pages;
+    out->cached_pages       = impl->radix  ? radix_cache_pages(impl->radix)
+                            : impl->hashes ? hash_cache_pages(impl->hashes) : impl->group_pages;
+    pthread_mutex_unlock(&impl->mutex);
+}
+
 static void paged_destroy(KVBackend* backend) {
     PagedKVImpl* impl = (PagedKVImpl*) backend->impl;
 
     for (size_t i = 0; i < impl->num_seqs; ++i) {
         paged_finish_sequence(backend, i);
-        free(impl->seqs[i].slots);
+        free(paged_seq(impl, i)->slots);
     }
-    free(impl->seqs);
+    seq_table_destroy(&impl->seqs);
+    free(impl->free_ids);
 
     for (size_t g = 0; g < impl->num_groups; ++g) {
-        SharedPrefix* pref = &impl->groups[g];
-        if (!pref->initialized) continue;
-        for (size_t i = 0; i < pref->num_pages; ++i) {
-            page_dec_ref(impl->alloc, pref->pages[i]);
-        }
-        free(pref->pages);
+        if (impl->groups[g].initialized) paged_drop_group(impl, &impl->groups[g]);
     }
     free(impl->groups);
+    evict_pool_destroy(&impl->pool);
+    radix_cache_destroy(impl->radix);
+    hash_cache_destroy(impl->hashes);
 
     page_allocator_destroy(impl->alloc);
     pthread_mutex_destroy(&impl->mutex);
@@ -220,11 +1052,18 @@ static void paged_destroy(KVBackend* backend) {
 }
 
 static const KVBackendVTable PAGED_VTABLE = {
-    .init_sequence   = paged_init_sequence,
-    .append_token    = paged_append_token,
-    .finish_sequence = paged_finish_sequence,
-    .stats           = paged_stats,
-    .destroy         = paged_destroy
+    .init_sequence     = paged_init_sequence,
+    .append_token      = paged_append_token,
+    .append_tokens     = paged_append_tokens,
+    .finish_sequence   = paged_finish_sequence,
+    .truncate_sequence = paged_truncate_sequence,
+    .can_admit         = paged_can_admit,
+    .preempt_sequence  = paged_preempt_sequence,
+    .resume_sequence   = paged_resume_sequence,
+    .fork_sequence     = paged_fork_sequence,
+    .stats             = paged_stats,
+    .counters          = paged_counters,
+    .destroy           = paged_destroy
 };
 
 KVBackend* create_paged_backend(const SimConfig* cfg) {
@@ -233,7 +1072,15 @@ KVBackend* create_paged_backend(const SimConfig* cfg) {
     impl->cfg   = *cfg;
     impl->alloc = page_allocator_create(cfg);
     pthread_mutex_init(&impl->mutex, NULL);
+    seq_table_init(&impl->seqs, sizeof(PagedSeqState));
+    evict_pool_init(&impl->pool, cfg->cache_evict);
     paged_init_prefix_groups(impl);
+    if (cfg->prefix_cache == PREFIX_CACHE_RADIX) {
+        impl->radix = radix_cache_create(impl->alloc, cfg->tokens_per_page);
+    } else if (cfg->prefix_cache == PREFIX_CACHE_HASH) {
+        impl->hashes = hash_cache_create(impl->alloc, cfg->tokens_per_page,
+                                         page_allocator_num_pages(impl->alloc));
+    }
 
     b->vtable = &PAGED_VTABLE;
     b->impl   = impl;
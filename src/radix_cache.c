@@ -0,0 +1,177 @@
+#include <stdlib.h>
+#include <string.h>
+#include "radix_cache.h"
+
+struct RadixNode {
+    EvictEntry  entry;       // first, so entries convert back to nodes
+    RadixNode*  parent;      // NULL under the root
+    RadixNode** children;
+    size_t num_children;
+    size_t children_capacity;
+    size_t index;            // in RadixCache::nodes
+    size_t depth;            // pages above this one
+    uint64_t hash;           // of tokens[]
+    Page* page;
+    uint32_t tokens[];       // tokens_per_page IDs
+};
+
+struct RadixCache {
+    PageAllocator* alloc;
+    size_t tokens_per_page;
+    RadixNode root;          // no page, no tokens
+    RadixNode** nodes;       // every node but the root
+    size_t num_nodes;
+    size_t nodes_capacity;
+};
+
+static uint64_t block_hash(const uint32_t* block, size_t n) {
+    uint64_t h = 1469598103934665603ull;   // FNV-1a over whole IDs
+    for (size_t i = 0; i < n; ++i) {
+        h ^= block[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static void push_child(RadixNode* parent, RadixNode* child) {
+    if (parent->num_children == parent->children_capacity) {
+        size_t new_cap = parent->children_capacity == 0 ? 4 : parent->children_capacity * 2;
+        RadixNode** nc = (RadixNode**) realloc(parent->children, new_cap * sizeof(RadixNode*));
+        if (!nc) abort();
+        parent->children = nc;
+        parent->children_capacity = new_cap;
+    }
+    parent->children[parent->num_children++] = child;
+}
+
+static RadixNode* find_child(const RadixCache* c, const RadixNode* parent,
+                             const uint32_t* block, uint64_t hash) {
+    for (size_t i = 0; i < parent->num_children; ++i) {
+        RadixNode* ch = parent->children[i];
+        if (ch->hash == hash &&
+            memcmp(ch->tokens, block, c->tokens_per_page * sizeof(uint32_t)) == 0) {
+            return ch;
+        }
+    }
+    return NULL;
+}
+
+RadixCache* radix_cache_create(PageAllocator* pa, size_t tokens_per_page) {
+    RadixCache* c = (RadixCache*) calloc(1, sizeof(RadixCache));
+    if (!c) abort();
+    c->alloc = pa;
+    c->tokens_per_page = tokens_per_page;
+    return c;
+}
+
+void radix_cache_destroy(RadixCache* c) {
+    if (!c) return;
+    for (size_t i = 0; i < c->num_nodes; ++i) {
+        RadixNode* n = c->nodes[i];
+        page_dec_ref(c->alloc, n->page);
+        free(n->children);
+        free(n);
+    }
+    free(c->root.children);
+    free(c->nodes);
+    free(c);
+}
+
+size_t radix_cache_match(RadixCache* c, const uint32_t* tokens, size_t num_pages,
+                         EvictEntry** hits, RadixNode** last) {
+    RadixNode* cur = &c->root;
+    size_t tpp = c->tokens_per_page;
+    size_t matched = 0;
+    for (; matched < num_pages; ++matched) {
+        const uint32_t* block = tokens + matched * tpp;
+        RadixNode* ch = find_child(c, cur, block, block_hash(block, tpp));
+        if (!ch) break;
+        if (hits) {
+            page_inc_ref(c->alloc, ch->page);
+            hits[matched] = &ch->entry;
+        }
+        cur = ch;
+    }
+    if (last) *last = cur == &c->root ? NULL : cur;
+    return matched;
+}
+
+RadixNode* radix_cache_insert(RadixCache* c, RadixNode* parent,
+                              const uint32_t* block, Page* page, EvictEntry** adopted) {
+    RadixNode* p = parent ? parent : &c->root;
+    size_t tpp = c->tokens_per_page;
+    uint64_t hash = block_hash(block, tpp);
+    RadixNode* n = find_child(c, p, block, hash);
+    *adopted = NULL;
+    if (n) return n;
+
+    n = (RadixNode*) calloc(1, sizeof(RadixNode) + tpp * sizeof(uint32_t));
+    if (!n) abort();
+    n->parent = parent;
+    n->depth = parent ? parent->depth + 1 : 0;
+    evict_entry_init(&n->entry, n->depth + 1);
+    n->hash = hash;
+    n->page = page;
+    memcpy(n->tokens, block, tpp * sizeof(uint32_t));
+    page_inc_ref(c->alloc, page);
+    push_child(p, n);
+
+    if (c->num_nodes == c->nodes_capacity) {
+        size_t new_cap = c->nodes_capacity == 0 ? 64 : c->nodes_capacity * 2;
+        RadixNode** nn = (RadixNode**) realloc(c->nodes, new_cap * sizeof(RadixNode*));
+        if (!nn) abort();
+        c->nodes = nn;
+        c->nodes_capacity = new_cap;
+    }
+    n->index = c->num_nodes;
+    c->nodes[c->num_nodes++] = n;
+    *adopted = &n->entry;
+    return n;
+}
+
+RadixNode* radix_node_parent(const RadixNode* n) {
+    return n->parent;
+}
+
+EvictEntry* radix_node_entry(RadixNode* n) {
+    return &n->entry;
+}
+
+RadixNode* radix_entry_node(EvictEntry* e) {
+    return (RadixNode*) e;
+}
+
+Page* radix_entry_page(const EvictEntry* e) {
+    return ((const RadixNode*) e)->page;
+}
+
+static void remove_node(RadixCache* c, RadixNode* n) {
+    RadixNode* p = n->parent ? n->parent : &c->root;
+    for (size_t i = 0; i < p->num_children; ++i) {
+        if (p->children[i] == n) {
+            p->children[i] = p->children[--p->num_children];
+            break;
+        }
+    }
+    RadixNode* moved = c->nodes[--c->num_nodes];
+    c->nodes[n->index] = moved;
+    moved->index = n->index;
+
+    page_dec_ref(c->alloc, n->page);
+    free(n->children);
+    free(n);
+}
+
+int radix_cache_remove(RadixCache* c, EvictEntry* e, EvictEntry** parent_leaf) {
+    RadixNode* n = (RadixNode*) e;
+    *parent_leaf = NULL;
+    if (n->num_children > 0) return 0;
+    RadixNode* parent = n->parent;
+    remove_node(c, n);
+    if (parent && parent->num_children == 0) *parent_leaf = &parent->entry;
+    return 1;
+}
+
+size_t radix_cache_pages(const RadixCache* c) {
+    return c->num_nodes;
+}
@@ -0,0 +1,29 @@
+#include <stdlib.h>
+#include "seq_table.h"
+
+void seq_table_init(SeqTable* t, size_t elem_size) {
+    t->elem_size = elem_size;
+    t->capacity = 0;
+    t->num_chunks = 0;
+    for (size_t k = 0; k < SEQ_TABLE_CHUNKS; ++k) atomic_init(&t->chunks[k], NULL);
+}
+
+void seq_table_destroy(SeqTable* t) {
+    for (size_t k = 0; k < t->num_chunks; ++k) {
+        free(atomic_load_explicit(&t->chunks[k], memory_order_relaxed));
+    }
+    seq_table_init(t, t->elem_size);
+}
+
+// Release, so a reader that finds the chunk also sees it zeroed.
+void seq_table_reserve(SeqTable* t, size_t n) {
+    while (t->capacity < n) {
+        if (t->num_chunks == SEQ_TABLE_CHUNKS) abort();
+        size_t entries = (size_t) SEQ_TABLE_FIRST << t->num_chunks;
+        unsigned char* chunk = (unsigned char*) calloc(entries, t->elem_size);
+        if (!chunk) abort();
+        atomic_store_explicit(&t->chunks[t->num_chunks], chunk, memory_order_release);
+        t->num_chunks++;
+        t->capacity += entries;
+    }
+}
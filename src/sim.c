@@ -1,66 +1,79 @@
-#define _DEFAULT_SOURCE // Required for usleep
-#define _XOPEN_SOURCE 700   // or 600
-
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>     // Required for usleep
+#include <stdint.h>
 #include <pthread.h>
 #include "sim.h"
 #include "kv_backend.h"
 #include "workload.h"
+#include "worker_pool.h"
+#include "event_queue.h"
+#include "cost_model.h"
+#include "memstat.h"
 
 typedef struct ThreadArgs {
     KVBackend* backend;
     const SimConfig* cfg;
     const SequenceWork* work;
     size_t index;
+    size_t generated;
+    int    dropped;     // ran out of memory; nothing ever frees it here
 } ThreadArgs;
 
 static void* decode_thread(void* arg) {
     ThreadArgs* a = (ThreadArgs*) arg;
     const SequenceWork* w = &a->work[a->index];
 
-    SeqId id = kv_init_sequence(a->backend, w);
+    SeqId id;
+    if (kv_init_sequence(a->backend, w, &id) != KV_OK) {
+        a->dropped = 1;
+        return NULL;
+    }
 
     // Prompt
-    for (size_t t = 0; t < w->prompt_tokens; ++t) {
-        kv_append_token(a->backend, id);
-        if (a->cfg->enable_sleep) {
-            usleep(100); // 0.1 ms
-        }
+    if (kv_append_tokens(a->backend, id, w->prompt_tokens, NULL) != KV_OK) {
+        a->dropped = 1;
+        return NULL;
     }
     // Decode
     for (size_t t = 0; t < w->gen_tokens; ++t) {
-        kv_append_token(a->backend, id);
-        if (a->cfg->enable_sleep) {
-            usleep(100);
+        if (kv_append_token(a->backend, id) != KV_OK) {
+            a->dropped = 1;
+            return NULL;
         }
+        a->generated++;
     }
 
-    // FIX: Do NOT finish the sequence here. 
+    // FIX: Do NOT finish the sequence here.
     // We want to measure memory usage while all sequences are active (Peak Memory).
     // Cleanup will happen in kv_destroy().
     // kv_finish_sequence(a->backend, id);
     return NULL;
 }
 
-KVStats run_simulation(KVBackend* backend,
-                       const SimConfig* cfg,
-                       const SequenceWork* work) {
+static KVStats run_thread_per_sequence(KVBackend* backend,
+                                      const SimConfig* cfg,
+                                      const SequenceWork* work,
+                                      SimReport* rep) {
     size_t n = cfg->num_sequences;
     pthread_t* threads = (pthread_t*) malloc(n * sizeof(pthread_t));
     ThreadArgs* args   = (ThreadArgs*) malloc(n * sizeof(ThreadArgs));
 
     for (size_t i = 0; i < n; ++i) {
-        args[i].backend = backend;
-        args[i].cfg     = cfg;
-        args[i].work    = work;
-        args[i].index   = i;
+        args[i].backend   = backend;
+        args[i].cfg       = cfg;
+        args[i].work      = work;
+        args[i].index     = i;
+        args[i].generated = 0;
+        args[i].dropped   = 0;
         pthread_create(&threads[i], NULL, decode_thread, &args[i]);
     }
 
     for (size_t i = 0; i < n; ++i) {
         pthread_join(threads[i], NULL);
+        rep->prompt_tokens    += work[i].prompt_tokens;
+        rep->generated_tokens += args[i].generated;
+        if (args[i].dropped) rep->oom_dropped++;
+        else rep->completed++;
     }
 
     free(threads);
@@ -68,3 +81,963 @@ KVStats run_simulation(KVBackend* backend,
 
     return kv_stats(backend);
 }
+
+// Iteration-level driver: a fixed pool advances every active sequence by one
+// token per step, the way a serving engine runs one batched forward pass.
+typedef struct StepSeq {
+    size_t index;       // into work[]
+    size_t gen_tokens;
+    SeqId  id;
+    size_t generated;
+    int    dropped;     // ran out of memory; skipped from then on
+} StepSeq;
+
+typedef struct StepCtx {
+    KVBackend* backend;
+    const SequenceWork* work;
+    StepSeq* seqs;      // sorted longest generation first
+} StepCtx;
+
+static int cmp_gen_desc(const void* a, const void* b) {
+    const StepSeq* x = (const StepSeq*) a;
+    const StepSeq* y = (const StepSeq*) b;
+    if (x->gen_tokens != y->gen_tokens) return x->gen_tokens < y->gen_tokens ? 1 : -1;
+    return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+static void step_init(void* arg, size_t begin, size_t end, size_t worker) {
+    (void) worker;
+    StepCtx* c = (StepCtx*) arg;
+    for (size_t i = begin; i < end; ++i) {
+        StepSeq* s = &c->seqs[i];
+        if (kv_init_sequence(c->backend, &c->work[s->index], &s->id) != KV_OK) {
+            s->dropped = 1;
+        }
+    }
+}
+
+static void step_prefill(void* arg, size_t begin, size_t end, size_t worker) {
+    (void) worker;
+    StepCtx* c = (StepCtx*) arg;
+    for (size_t i = begin; i < end; ++i) {
+        StepSeq* s = &c->seqs[i];
+        size_t prompt = c->work[s->index].prompt_tokens;
+        if (!s->dropped && kv_append_tokens(c->backend, s->id, prompt, NULL) != KV_OK) {
+            s->dropped = 1;
+        }
+    }
+}
+
+static void step_decode(void* arg, size_t begin, size_t end, size_t worker) {
+    (void) worker;
+    StepCtx* c = (StepCtx*) arg;
+    for (size_t i = begin; i < end; ++i) {
+        StepSeq* s = &c->seqs[i];
+        if (s->dropped) continue;
+        if (kv_append_token(c->backend, s->id) != KV_OK) s->dropped = 1;
+        else s->generated++;
+    }
+}
+
+static KVStats run_worker_pool(KVBackend* backend,
+                               const SimConfig* cfg,
+                               const SequenceWork* work,
+                               SimReport* rep) {
+    size_t n = cfg->num_sequences;
+    size_t bpt = bytes_per_token(cfg);
+    StepSeq* seqs = (StepSeq*) malloc(n * sizeof(StepSeq));
+    if (n > 0 && !seqs) abort();
+    for (size_t i = 0; i < n; ++i) {
+        seqs[i].index      = i;
+        seqs[i].gen_tokens = work[i].gen_tokens;
+        seqs[i].id         = 0;
+        seqs[i].generated  = 0;
+        seqs[i].dropped    = 0;
+        rep->prompt_tokens += work[i].prompt_tokens;
+    }
+    // Longest-first order makes the active set of step s a prefix of seqs[].
+    qsort(seqs, n, sizeof(StepSeq), cmp_gen_desc);
+
+    StepCtx ctx = { backend, work, seqs };
+    WorkerPool* pool = worker_pool_create(cfg->num_workers);
+
+    worker_pool_parallel_for(pool, n, step_init, &ctx);
+    worker_pool_parallel_for(pool, n, step_prefill, &ctx);
+
+    // Step shapes follow the planned schedule; sequences dropped for lack
+    // of memory only show up in the token and completion counts.
+    size_t resident_tokens = rep->prompt_tokens;
+    StepShape shape = { .prefill_tokens = rep->prompt_tokens, .decode_seqs = 0,
+                        .kv_bytes = resident_tokens * bpt, .swap_bytes = 0 };
+    rep->makespan_ns += cost_model_step_ns(&cfg->cost, &shape);
+    rep->steps++;
+
+    size_t active = n;
+    for (size_t step = 1; active > 0; ++step) {
+        while (active > 0 && seqs[active - 1].gen_tokens < step) active--;
+        if (active == 0) break;
+        worker_pool_parallel_for(pool, active, step_decode, &ctx);
+
+        resident_tokens += active;
+        shape = (StepShape){ .prefill_tokens = 0, .decode_seqs = active,
+                             .kv_bytes = resident_tokens * bpt, .swap_bytes = 0 };
+        rep->makespan_ns += cost_model_step_ns(&cfg->cost, &shape);
+        rep->steps++;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        rep->generated_tokens += seqs[i].generated;
+        if (seqs[i].dropped) rep->oom_dropped++;
+        else rep->completed++;
+    }
+
+    worker_pool_destroy(pool);
+    free(seqs);
+    return kv_stats(backend);
+}
+
+// Beam search on the worker pool's step schedule. Every request keeps
+// cfg->beam_width beams: before each decode step it re-ranks them, forks the
+// beams that won several of the next slots and finishes the ones that won
+// none, so KV memory is forked and freed every step. Ranking is simulated:
+// each slot goes to a random beam, skewed toward the better-ranked ones.
+// Forks and prunes run serially between the parallel decode phases.
+typedef struct BeamReq {
+    size_t   index;       // into work[]
+    size_t   gen_tokens;
+    SeqId*   beams;       // num_beams live ids, best first
+    size_t   num_beams;
+    size_t   generated;   // tokens appended over all beams
+    uint64_t rng;
+    int      dropped;     // ran out of memory; its beams are finished
+} BeamReq;
+
+typedef struct BeamCtx {
+    KVBackend* backend;
+    const SequenceWork* work;
+    BeamReq* reqs;        // sorted longest generation first
+    size_t   width;
+    size_t*  wins;        // width scratch slots for beam_rerank
+    SeqId*   next;
+} BeamCtx;
+
+// xorshift64*: per-request streams keep the parallel phases reproducible.
+static uint64_t step_rand(uint64_t* state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static double step_rand_unit(uint64_t* state) {
+    return (double) (step_rand(state) >> 11) * 0x1.0p-53;
+}
+
+static int cmp_beam_gen_desc(const void* a, const void* b) {
+    const BeamReq* x = (const BeamReq*) a;
+    const BeamReq* y = (const BeamReq*) b;
+    if (x->gen_tokens != y->gen_tokens) return x->gen_tokens < y->gen_tokens ? 1 : -1;
+    return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+static void beam_finish(KVBackend* backend, BeamReq* r) {
+    for (size_t j = 0; j < r->num_beams; ++j) kv_finish_sequence(backend, r->beams[j]);
+    r->num_beams = 0;
+}
+
+static void beam_init(void* arg, size_t begin, size_t end, size_t worker) {
+    (void) worker;
+    BeamCtx* c = (BeamCtx*) arg;
+    for (size_t i = begin; i < end; ++i) {
+        BeamReq* r = &c->reqs[i];
+        if (kv_init_sequence(c->backend, &c->work[r->index], &r->beams[0]) == KV_OK) {
+            r->num_beams = 1;
+        } else {
+            r->dropped = 1;
+        }
+    }
+}
+
+static void beam_prefill(void* arg, size_t begin, size_t end, size_t worker) {
+    (void) worker;
+    BeamCtx* c = (BeamCtx*) arg;
+    for (size_t i = begin; i < end; ++i) {
+        BeamReq* r = &c->reqs[i];
+        size_t prompt = c->work[r->index].prompt_tokens;
+        if (!r->dropped && kv_append_tokens(c->backend, r->beams[0], prompt, NULL) != KV_OK) {
+            beam_finish(c->backend, r);
+            r->dropped = 1;
+        }
+    }
+}
+
+static void beam_decode(void* arg, size_t begin, size_t end, size_t worker) {
+    (void) worker;
+    BeamCtx* c = (BeamCtx*) arg;
+    for (size_t i = begin; i < end; ++i) {
+        BeamReq* r = &c->reqs[i];
+        for (size_t j = 0; j < r->num_beams && !r->dropped; ++j) {
+            if (kv_append_token(c->backend, r->beams[j]) != KV_OK) {
+                beam_finish(c->backend, r);
+                r->dropped = 1;
+            } else {
+                r->generated++;
+            }
+        }
+    }
+}
+
+// Prunes before forking so the forks can use the memory the losers held.
+static void beam_rerank(BeamCtx* c, BeamReq* r, SimReport* rep) {
+    size_t n = r->num_beams;
+    for (size_t j = 0; j < n; ++j) c->wins[j] = 0;
+    for (size_t k = 0; k < c->width; ++k) {
+        size_t a = (size_t) (step_rand(&r->rng) % n);
+        size_t b = (size_t) (step_rand(&r->rng) % n);
+        c->wins[a < b ? a : b]++;
+    }
+    for (size_t j = 0; j < n; ++j) {
+        if (c->wins[j] > 0) continue;
+        kv_finish_sequence(c->backend, r->beams[j]);
+        rep->beam_prunes++;
+    }
+    size_t kept = 0;
+    for (size_t j = 0; j < n; ++j) {
+        if (c->wins[j] == 0) continue;
+        c->next[kept++] = r->beams[j];
+        for (size_t f = 1; f < c->wins[j]; ++f) {
+            SeqId child;
+            if (kv_fork_sequence(c->backend, r->beams[j], NULL, &child) == KV_OK) {
+                c->next[kept++] = child;
+                rep->beam_forks++;
+            } else {
+                rep->beam_fork_failures++;
+            }
+        }
+    }
+    for (size_t j = 0; j < kept; ++j) r->beams[j] = c->next[j];
+    r->num_beams = kept;
+}
+
+static void track_peak(KVBackend* backend, SimReport* rep, KVStats* st) {
+    *st = kv_stats(backend);
+    if (st->physical_bytes >= rep->peak.physical_bytes) rep->peak = *st;
+}
+
+static KVStats run_beam_search(KVBackend* backend,
+                               const SimConfig* cfg,
+                               const SequenceWork* work,
+                               SimReport* rep) {
+    size_t n = cfg->num_sequences;
+    size_t width = cfg->beam_width ? cfg->beam_width : 1;
+    if (!kv_can_fork(backend)) width = 1;
+
+    BeamReq* reqs = (BeamReq*) malloc(n * sizeof(BeamReq));
+    SeqId* ids    = (SeqId*) malloc(n * width * sizeof(SeqId));
+    size_t* wins  = (size_t*) malloc(width * sizeof(size_t));
+    SeqId* next   = (SeqId*) malloc(width * sizeof(SeqId));
+    if ((n > 0 && (!reqs || !ids)) || !wins || !next) abort();
+    for (size_t i = 0; i < n; ++i) {
+        reqs[i].index      = i;
+        reqs[i].gen_tokens = work[i].gen_tokens;
+        reqs[i].beams      = ids + i * width;
+        reqs[i].num_beams  = 0;
+        reqs[i].generated  = 0;
+        reqs[i].rng        = work[i].stream_id * 0x9E3779B97F4A7C15ULL + 1;
+        reqs[i].dropped    = 0;
+        rep->prompt_tokens += work[i].prompt_tokens;
+    }
+    qsort(reqs, n, sizeof(BeamReq), cmp_beam_gen_desc);
+
+    BeamCtx ctx = { backend, work, reqs, width, wins, next };
+    WorkerPool* pool = worker_pool_create(cfg->num_workers);
+
+    worker_pool_parallel_for(pool, n, beam_init, &ctx);
+    worker_pool_parallel_for(pool, n, beam_prefill, &ctx);
+
+    KVStats st;
+    track_peak(backend, rep, &st);
+    StepShape shape = { .prefill_tokens = rep->prompt_tokens, .decode_seqs = 0,
+                        .kv_bytes = st.logical_bytes, .swap_bytes = 0 };
+    rep->makespan_ns += cost_model_step_ns(&cfg->cost, &shape);
+    rep->steps++;
+
+    size_t active = n;
+    for (size_t step = 1; ; ++step) {
+        // Finished requests hand their beams back before the rest fork.
+        while (active > 0 && reqs[active - 1].gen_tokens < step) {
+            beam_finish(backend, &reqs[--active]);
+        }
+        if (active == 0) break;
+
+        size_t beams = 0;
+        for (size_t i = 0; i < active; ++i) {
+            if (reqs[i].dropped) continue;
+            beam_rerank(&ctx, &reqs[i], rep);
+            beams += reqs[i].num_beams;
+        }
+        worker_pool_parallel_for(pool, active, beam_decode, &ctx);
+
+        track_peak(backend, rep, &st);
+        shape = (StepShape){ .prefill_tokens = 0, .decode_seqs = beams,
+                             .kv_bytes = st.logical_bytes, .swap_bytes = 0 };
+        rep->makespan_ns += cost_model_step_ns(&cfg->cost, &shape);
+        rep->steps++;
+        if (beams > rep->peak_running) rep->peak_running = beams;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        rep->generated_tokens += reqs[i].generated;
+        if (reqs[i].dropped) rep->oom_dropped++;
+        else rep->completed++;
+    }
+
+    worker_pool_destroy(pool);
+    free(next);
+    free(wins);
+    free(ids);
+    free(reqs);
+    return rep->peak;
+}
+
+// Speculative decoding on the worker pool's step schedule. Each step a
+// request appends cfg->spec_draft_tokens draft tokens, keeps the leading
+// ones the target model accepts (each with probability spec_accept_rate)
+// and truncates the rest away, then appends the target's own next token.
+// A rollback that empties a page releases it, so drafts crossing a page
+// boundary cost an alloc and a free.
+typedef struct SpecReq {
+    size_t   index;       // into work[]
+    SeqId    id;
+    size_t   generated;
+    size_t   drafted;
+    size_t   accepted;
+    uint64_t rng;
+    int      started;     // holds an id
+    int      dropped;     // ran out of memory
+} SpecReq;
+
+typedef struct SpecCtx {
+    KVBackend* backend;
+    const SimConfig* cfg;
+    const SequenceWork* work;
+    SpecReq* reqs;        // the first num_active are still decoding
+} SpecCtx;
+
+static void spec_init(void* arg, size_t begin, size_t end, size_t worker) {
+    (void) worker;
+    SpecCtx* c = (SpecCtx*) arg;
+    for (size_t i = begin; i < end; ++i) {
+        SpecReq* r = &c->reqs[i];
+        if (kv_init_sequence(c->backend, &c->work[r->index], &r->id) == KV_OK) r->started = 1;
+        else r->dropped = 1;
+    }
+}
+
+static void spec_prefill(void* arg, size_t begin, size_t end, size_t worker) {
+    (void) worker;
+    SpecCtx* c = (SpecCtx*) arg;
+    for (size_t i = begin; i < end; ++i) {
+        SpecReq* r = &c->reqs[i];
+        size_t prompt = c->work[r->index].prompt_tokens;
+        if (!r->dropped && kv_append_tokens(c->backend, r->id, prompt, NULL) != KV_OK) {
+            r->dropped = 1;
+        }
+    }
+}
+
+static void spec_step(void* arg, size_t begin, size_t end, size_t worker) {
+    (void) worker;
+    SpecCtx* c = (SpecCtx*) arg;
+    for (size_t i = begin; i < end; ++i) {
+        SpecReq* r = &c->reqs[i];
+        const SequenceWork* w = &c->work[r->index];
+        if (r->dropped || r->generated >= w->gen_tokens) continue;
+
+        // Never draft past the sequence's budget: the target's token is
+        // always one more.
+        size_t left = w->gen_tokens - r->generated;
+        size_t k = c->cfg->spec_draft_tokens < left - 1 ? c->cfg->spec_draft_tokens : left - 1;
+        size_t base = w->prompt_tokens + r->generated;
+        size_t t = 0;
+        for (; t < k; ++t) {
+            if (kv_append_token(c->backend, r->id) != KV_OK) break;
+        }
+        size_t a = 0;
+        while (a < t && step_rand_unit(&r->rng) < c->cfg->spec_accept_rate) a++;
+        kv_truncate_sequence(c->backend, r->id, base + a);
+        if (kv_append_token(c->backend, r->id) != KV_OK) {
+            r->dropped = 1;
+            continue;
+        }
+        r->drafted   += t;
+        r->accepted  += a;
+        r->generated += a + 1;
+    }
+}
+
+static KVStats run_speculative(KVBackend* backend,
+                               const SimConfig* cfg,
+                               const SequenceWork* work,
+                               SimReport* rep) {
+    size_t n = cfg->num_sequences;
+    SpecReq* reqs = (SpecReq*) malloc(n * sizeof(SpecReq));
+    if (n > 0 && !reqs) abort();
+    for (size_t i = 0; i < n; ++i) {
+        reqs[i] = (SpecReq){ i, 0, 0, 0, 0, work[i].stream_id * 0x9E3779B97F4A7C15ULL + 1, 0, 0 };
+        rep->prompt_tokens += work[i].prompt_tokens;
+    }
+
+    SpecCtx ctx = { backend, cfg, work, reqs };
+    WorkerPool* pool = worker_pool_create(cfg->num_workers);
+
+    worker_pool_parallel_for(pool, n, spec_init, &ctx);
+    worker_pool_parallel_for(pool, n, spec_prefill, &ctx);
+
+    KVStats st;
+    track_peak(backend, rep, &st);
+    StepShape shape = { .prefill_tokens = rep->prompt_tokens, .decode_seqs = 0,
+                        .kv_bytes = st.logical_bytes, .swap_bytes = 0 };
+    rep->makespan_ns += cost_model_step_ns(&cfg->cost, &shape);
+    rep->steps++;
+
+    size_t active = n;
+    for (;;) {
+        // Finished and dropped requests leave the batch; order does not
+        // matter since every request draws from its own stream.
+        for (size_t i = 0; i < active; ) {
+            SpecReq* r = &reqs[i];
+            if (!r->dropped && r->generated < work[r->index].gen_tokens) {
+                ++i;
+                continue;
+            }
+            if (r->started) kv_finish_sequence(backend, r->id);
+            SpecReq done = *r;
+            *r = reqs[--active];
+            reqs[active] = done;
+        }
+        if (active == 0) break;
+
+        // Verifying the drafts costs the target model a prefill of them.
+        size_t drafts = 0;
+        for (size_t i = 0; i < active; ++i) {
+            size_t left = work[reqs[i].index].gen_tokens - reqs[i].generated;
+            drafts += cfg->spec_draft_tokens < left - 1 ? cfg->spec_draft_tokens : left - 1;
+        }
+        worker_pool_parallel_for(pool, active, spec_step, &ctx);
+
+        track_peak(backend, rep, &st);
+        shape = (StepShape){ .prefill_tokens = drafts, .decode_seqs = active,
+                             .kv_bytes = st.logical_bytes, .swap_bytes = 0 };
+        rep->makespan_ns += cost_model_step_ns(&cfg->cost, &shape);
+        rep->steps++;
+        if (active > rep->peak_running) rep->peak_running = active;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        rep->generated_tokens += reqs[i].generated;
+        rep->spec_drafted     += reqs[i].drafted;
+        rep->spec_accepted    += reqs[i].accepted;
+        if (reqs[i].dropped) rep->oom_dropped++;
+        else rep->completed++;
+    }
+
+    worker_pool_destroy(pool);
+    free(reqs);
+    return rep->peak;
+}
+
+// Continuous batching as a discrete-event simulation. Requests arrive at
+// work[i].arrival_ns, wait FCFS until the backend can admit them, prefill in
+// their first step and decode one token per step after that. Each step's
+// virtual duration comes from cfg->cost, so no wall-clock time is spent
+// modelling compute and runs are reproducible.
+//
+// Under ADMIT_OPTIMISTIC a running sequence can find no page for its next
+// token. Its step is lost (oom_stalls); with OOM_PREEMPT a victim chosen by
+// cfg->victim_policy is also evicted and put back at the head of the queue.
+// Backends with kv_preempt_sequence keep its id and either swap its pages
+// out or drop them (cfg->preempt_mode); otherwise it is finished and all of
+// its prompt and generated tokens are recomputed when it is readmitted.
+enum {
+    EV_ARRIVAL   = 0,   // arg = workload index
+    EV_STEP_DONE = 1,
+};
+
+#define NOT_YET UINT64_MAX
+
+// Per request; survives preemption.
+typedef struct ReqState {
+    SeqId    id;
+    uint64_t first_token_ns;
+    size_t   decoded;
+    size_t   kv_tokens;     // held by the backend right now
+    size_t   target;        // kv_tokens to rebuild before decoding resumes
+    size_t   admit_seq;     // larger = admitted more recently
+    int      admitted;      // has been admitted at least once
+    int      preempted;     // id is kept by the backend, memory is not
+} ReqState;
+
+typedef struct RunSeq {
+    size_t index;           // into work[]
+    size_t prefill;         // prompt tokens to ingest this step
+    int    failed;          // last step ran out of memory
+    int    progressed;      // last step appended at least one token
+} RunSeq;
+
+typedef struct Engine {
+    KVBackend* backend;
+    const SimConfig* cfg;
+    const SequenceWork* work;
+    WorkerPool* pool;
+    EventQueue events;
+    SimReport* rep;
+
+    ReqState* reqs;
+    size_t*   waiting;      // ring buffer of workload indices, FCFS
+    size_t    wait_head, wait_len, wait_cap;
+    RunSeq*   running;
+    size_t    num_running;
+    size_t    admit_count;
+    size_t    swap_bytes_seen;  // KVCounters swap traffic already costed
+    size_t    allocs_seen;      // KVCounters page allocs at the last step
+    int       busy;         // a STEP_DONE event is pending
+
+    uint64_t* ttft_ns;      // per completed request
+    uint64_t* latency_ns;
+    uint64_t* decode_step_ns;   // per step that decoded
+    size_t    num_decode_steps, decode_step_cap;
+    double    sum_tpot_ns;
+    size_t    num_tpot;
+    double    sum_queue_ns;
+    size_t    num_admitted;
+
+    // Piecewise-constant occupancy, integrated over virtual time.
+    uint64_t last_ns;
+    KVStats  cur;
+    size_t   cur_running;
+    double   area_running, area_logical, area_physical;
+    size_t   rss_base;      // SimConfig::touch_kv: measured RSS at the start
+    size_t   cur_rss;       // and its growth since, as of the last step
+    double   area_rss;
+} Engine;
+
+static void wait_push_back(Engine* e, size_t idx) {
+    e->waiting[(e->wait_head + e->wait_len++) % e->wait_cap] = idx;
+}
+
+static void wait_push_front(Engine* e, size_t idx) {
+    e->wait_head = (e->wait_head + e->wait_cap - 1) % e->wait_cap;
+    e->waiting[e->wait_head] = idx;
+    e->wait_len++;
+}
+
+static void wait_pop_front(Engine* e) {
+    e->wait_head = (e->wait_head + 1) % e->wait_cap;
+    e->wait_len--;
+}
+
+static void batch_step(void* arg, size_t begin, size_t end, size_t worker) {
+    (void) worker;
+    Engine* e = (Engine*) arg;
+    for (size_t i = begin; i < end; ++i) {
+        RunSeq* r = &e->running[i];
+        ReqState* q = &e->reqs[r->index];
+        r->failed = 0;
+        r->progressed = 0;
+        if (q->kv_tokens < q->target) {
+            size_t done = 0;
+            if (kv_append_tokens(e->backend, q->id, r->prefill, &done) != KV_OK) {
+                r->failed = 1;
+            }
+            q->kv_tokens += done;
+            r->progressed = done > 0;
+        } else if (kv_append_token(e->backend, q->id) == KV_OK) {
+            q->kv_tokens++;
+            q->decoded++;
+            r->progressed = 1;
+        } else {
+            r->failed = 1;
+        }
+    }
+}
+
+static void engine_advance(Engine* e, uint64_t now) {
+    double dt = (double) (now - e->last_ns);
+    e->area_running  += dt * (double) e->cur_running;
+    e->area_logical  += dt * (double) e->cur.logical_bytes;
+    e->area_physical += dt * (double) e->cur.physical_bytes;
+    e->area_rss      += dt * (double) e->cur_rss;
+    e->last_ns = now;
+}
+
+static size_t engine_rss(const Engine* e) {
+    if (!e->cfg->touch_kv) return 0;
+    size_t rss = memstat_rss_bytes();
+    return rss > e->rss_base ? rss - e->rss_base : 0;
+}
+
+static void engine_admit(Engine* e) {
+    SimReport* rep = e->rep;
+    size_t bpt = bytes_per_token(e->cfg);
+    size_t free_bytes = 0;
+    int have_free = 0;
+    while (e->wait_len > 0) {
+        size_t idx = e->waiting[e->wait_head];
+        const SequenceWork* w = &e->work[idx];
+        ReqState* q = &e->reqs[idx];
+        size_t need = (w->prompt_tokens + q->decoded) * bpt;
+
+        if (e->cfg->admission == ADMIT_RESERVE) {
+            // A preempted sequence still holds its reservation.
+            if (!q->preempted && !kv_can_admit(e->backend, w)) {
+                if (e->num_running > 0) break;   // head-of-line blocks the rest
+                rep->rejected++;                 // would never fit
+                wait_pop_front(e);
+                continue;
+            }
+        } else {
+            // Admit on what the prompt needs now, not what the sequence may
+            // grow to. An idle backend always gets to try.
+            if (!have_free) {
+                KVStats st = kv_stats(e->backend);
+                free_bytes = st.capacity_bytes > st.physical_bytes
+                           ? st.capacity_bytes - st.physical_bytes : 0;
+                have_free = 1;
+            }
+            if (need > free_bytes && e->num_running > 0) break;
+        }
+
+        size_t recompute = 0;
+        KVStatus st = q->preempted
+            ? kv_resume_sequence(e->backend, q->id, &recompute)
+            : kv_init_sequence(e->backend, w, &q->id);
+        if (st != KV_OK) {
+            rep->oom_requeues++;
+            if (e->num_running > 0) break;
+            if (q->preempted) kv_finish_sequence(e->backend, q->id);
+            q->preempted = 0;
+            rep->rejected++;
+            wait_pop_front(e);
+            continue;
+        }
+        wait_pop_front(e);
+        free_bytes -= need < free_bytes ? need : free_bytes;
+
+        q->kv_tokens = q->preempted ? q->kv_tokens - recompute : 0;
+        q->preempted = 0;
+        q->target    = w->prompt_tokens + q->decoded;
+        q->admit_seq = e->admit_count++;
+        if (!q->admitted) {
+            q->admitted = 1;
+            rep->prompt_tokens += w->prompt_tokens;
+            e->sum_queue_ns += (double) (e->last_ns - w->arrival_ns);
+            e->num_admitted++;
+        }
+        RunSeq* r = &e->running[e->num_running++];
+        r->index      = idx;
+        r->prefill    = 0;
+        r->failed     = 0;
+        r->progressed = 0;
+    }
+}
+
+// Releases running[i]'s pages. Swap-removes it, so the caller must revisit
+// slot i.
+static void engine_evict(Engine* e, size_t i, int requeue) {
+    ReqState* q = &e->reqs[e->running[i].index];
+    if (requeue && kv_can_preempt(e->backend)) {
+        kv_preempt_sequence(e->backend, q->id);
+        q->preempted = 1;
+    } else {
+        kv_finish_sequence(e->backend, q->id);
+        q->kv_tokens = 0;
+    }
+    if (requeue) {
+        wait_push_front(e, e->running[i].index);
+        e->rep->oom_preemptions++;
+    } else {
+        e->rep->rejected++;
+    }
+    e->running[i] = e->running[--e->num_running];
+}
+
+// Non-zero if running[a] should be preempted before running[b].
+static int victim_before(const Engine* e, size_t a, size_t b) {
+    size_t ia = e->running[a].index, ib = e->running[b].index;
+    const ReqState* qa = &e->reqs[ia];
+    const ReqState* qb = &e->reqs[ib];
+    switch (e->cfg->victim_policy) {
+    case VICTIM_LOWEST_PRIORITY:
+        if (e->work[ia].priority != e->work[ib].priority) {
+            return e->work[ia].priority < e->work[ib].priority;
+        }
+        break;
+    case VICTIM_LONGEST:
+        if (qa->kv_tokens != qb->kv_tokens) return qa->kv_tokens > qb->kv_tokens;
+        break;
+    case VICTIM_LIFO:
+    default:
+        break;
+    }
+    return qa->admit_seq > qb->admit_seq;
+}
+
+static size_t engine_pick_victim(const Engine* e) {
+    size_t v = 0;
+    for (size_t i = 1; i < e->num_running; ++i) {
+        if (victim_before(e, i, v)) v = i;
+    }
+    return v;
+}
+
+// Decodes first, one token each; prefilling sequences then split what is
+// left of the step's token budget, at most one chunk each, in running
+// order. A sequence whose share is zero just waits for the next step.
+static void engine_plan_step(Engine* e, StepShape* shape) {
+    size_t budget = e->cfg->step_token_budget;
+    size_t chunk  = e->cfg->prefill_chunk_tokens;
+    for (size_t i = 0; i < e->num_running; ++i) {
+        const ReqState* q = &e->reqs[e->running[i].index];
+        if (q->kv_tokens >= q->target) shape->decode_seqs++;
+    }
+    size_t used = shape->decode_seqs;
+    for (size_t i = 0; i < e->num_running; ++i) {
+        RunSeq* r = &e->running[i];
+        const ReqState* q = &e->reqs[r->index];
+        r->prefill = 0;
+        if (q->kv_tokens >= q->target) continue;
+        size_t n = q->target - q->kv_tokens;
+        if (chunk > 0 && n > chunk) n = chunk;
+        if (budget > 0) {
+            size_t left = budget > used ? budget - used : 0;
+            if (n > left) n = left;
+        }
+        r->prefill = n;
+        used += n;
+        shape->prefill_tokens += n;
+    }
+}
+
+static void engine_start_step(Engine* e, uint64_t now) {
+    engine_advance(e, now);
+    engine_admit(e);
+    if (e->num_running == 0) {
+        e->busy = 0;
+        e->cur = kv_stats(e->backend);
+        e->cur_rss = engine_rss(e);
+        e->cur_running = 0;
+        return;
+    }
+
+    // Swaps done by this round of preemption and admission ride on this step.
+    KVCounters c = kv_counters(e->backend);
+    size_t swapped = c.swapped_out_bytes + c.swapped_in_bytes;
+    StepShape shape = { .prefill_tokens = 0, .decode_seqs = 0, .kv_bytes = 0,
+                        .swap_bytes = swapped - e->swap_bytes_seen };
+    e->swap_bytes_seen = swapped;
+    engine_plan_step(e, &shape);
+    worker_pool_parallel_for(e->pool, e->num_running, batch_step, e);
+
+    size_t allocs = kv_counters(e->backend).alloc.allocs;
+    if (allocs - e->allocs_seen > e->rep->peak_step_allocs) {
+        e->rep->peak_step_allocs = allocs - e->allocs_seen;
+    }
+    e->allocs_seen = allocs;
+
+    KVStats st = kv_stats(e->backend);
+    e->cur = st;
+    e->cur_rss = engine_rss(e);
+    e->cur_running = e->num_running;
+    if (st.physical_bytes >= e->rep->peak.physical_bytes) e->rep->peak = st;
+    if (e->num_running > e->rep->peak_running) e->rep->peak_running = e->num_running;
+
+    shape.kv_bytes = st.logical_bytes;
+    uint64_t dur = cost_model_step_ns(&e->cfg->cost, &shape);
+    if (shape.decode_seqs > 0) {
+        if (e->num_decode_steps == e->decode_step_cap) {
+            e->decode_step_cap = e->decode_step_cap ? 2 * e->decode_step_cap : 1024;
+            e->decode_step_ns = (uint64_t*) realloc(e->decode_step_ns,
+                                                    e->decode_step_cap * sizeof(uint64_t));
+            if (!e->decode_step_ns) abort();
+        }
+        e->decode_step_ns[e->num_decode_steps++] = dur;
+    }
+    event_queue_push(&e->events, now + dur, EV_STEP_DONE, 0);
+    e->busy = 1;
+    e->rep->steps++;
+}
+
+static void engine_finish_step(Engine* e, uint64_t now) {
+    SimReport* rep = e->rep;
+    engine_advance(e, now);
+
+    size_t failed = 0;
+    int progressed = 0;
+    for (size_t i = 0; i < e->num_running; ) {
+        RunSeq* r = &e->running[i];
+        ReqState* q = &e->reqs[r->index];
+        const SequenceWork* w = &e->work[r->index];
+        if (r->failed) failed++;
+        if (r->progressed) progressed = 1;
+        if (q->kv_tokens < q->target) {
+            ++i;
+            continue;
+        }
+        if (q->first_token_ns == NOT_YET) q->first_token_ns = now;
+        if (q->decoded >= w->gen_tokens) {
+            kv_finish_sequence(e->backend, q->id);
+            e->ttft_ns[rep->completed]    = q->first_token_ns - w->arrival_ns;
+            e->latency_ns[rep->completed] = now - w->arrival_ns;
+            rep->completed++;
+            rep->generated_tokens += q->decoded;
+            if (q->decoded > 0) {
+                e->sum_tpot_ns += (double) (now - q->first_token_ns) / (double) q->decoded;
+                e->num_tpot++;
+            }
+            e->running[i] = e->running[--e->num_running];
+            progressed = 1;
+        } else {
+            ++i;
+        }
+    }
+
+    if (failed > 0) {
+        rep->oom_stalls += failed;
+        if (e->num_running == 1 && e->running[0].failed) {
+            // Alone and still out of memory: it can never fit.
+            engine_evict(e, 0, 0);
+        } else if (e->cfg->oom_policy == OOM_PREEMPT) {
+            for (size_t k = 0; k < failed && e->num_running > 1; ++k) {
+                engine_evict(e, engine_pick_victim(e), 1);
+            }
+        } else if (!progressed) {
+            // Every sequence is waiting on every other: break the deadlock.
+            engine_evict(e, engine_pick_victim(e), 1);
+        }
+    }
+    engine_start_step(e, now);
+}
+
+static int cmp_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+    return x < y ? -1 : (x > y);
+}
+
+static LatencySummary summarize(uint64_t* v, size_t n) {
+    LatencySummary s = { 0.0, 0, 0, 0 };
+    if (n == 0) return s;
+    qsort(v, n, sizeof(uint64_t), cmp_u64);
+    double sum = 0.0;
+    for (size_t i = 0; i < n; ++i) sum += (double) v[i];
+    s.mean_ns = sum / (double) n;
+    s.p50_ns  = v[(n - 1) / 2];
+    s.p99_ns  = v[(n - 1) * 99 / 100];
+    s.max_ns  = v[n - 1];
+    return s;
+}
+
+static KVStats run_continuous(KVBackend* backend,
+                              const SimConfig* cfg,
+                              const SequenceWork* work,
+                              SimReport* rep) {
+    size_t n = cfg->num_sequences;
+    size_t cap = n ? n : 1;
+    Engine e = {0};
+    e.backend    = backend;
+    e.cfg        = cfg;
+    e.work       = work;
+    e.rep        = rep;
+    e.reqs       = (ReqState*) malloc(cap * sizeof(ReqState));
+    e.waiting    = (size_t*) malloc(cap * sizeof(size_t));
+    e.wait_cap   = cap;
+    e.running    = (RunSeq*) malloc(cap * sizeof(RunSeq));
+    e.ttft_ns    = (uint64_t*) malloc(cap * sizeof(uint64_t));
+    e.latency_ns = (uint64_t*) malloc(cap * sizeof(uint64_t));
+    if (!e.reqs || !e.waiting || !e.running || !e.ttft_ns || !e.latency_ns) abort();
+    e.pool = worker_pool_create(cfg->num_workers);
+    event_queue_init(&e.events);
+
+    uint64_t first_arrival = NOT_YET;
+    for (size_t i = 0; i < n; ++i) {
+        e.reqs[i] = (ReqState){ 0, NOT_YET, 0, 0, 0, 0, 0, 0 };
+        event_queue_push(&e.events, work[i].arrival_ns, EV_ARRIVAL, i);
+        if (work[i].arrival_ns < first_arrival) first_arrival = work[i].arrival_ns;
+    }
+    e.last_ns = first_arrival == NOT_YET ? 0 : first_arrival;
+    e.cur = kv_stats(backend);
+    if (cfg->touch_kv) e.rss_base = memstat_rss_bytes();
+    e.allocs_seen = kv_counters(backend).alloc.allocs;
+
+    SimEvent ev;
+    while (event_queue_pop(&e.events, &ev)) {
+        if (ev.type == EV_ARRIVAL) {
+            wait_push_back(&e, ev.arg);
+            if (!e.busy) engine_start_step(&e, ev.time_ns);
+        } else {
+            engine_finish_step(&e, ev.time_ns);
+        }
+    }
+
+    rep->makespan_ns = e.last_ns - (first_arrival == NOT_YET ? 0 : first_arrival);
+    if (rep->makespan_ns > 0) {
+        double span = (double) rep->makespan_ns;
+        rep->mean_running        = e.area_running / span;
+        rep->mean_logical_bytes  = e.area_logical / span;
+        rep->mean_physical_bytes = e.area_physical / span;
+        rep->mean_rss_bytes      = e.area_rss / span;
+    }
+    if (e.num_admitted > 0) rep->mean_queue_ns = e.sum_queue_ns / (double) e.num_admitted;
+    if (e.num_tpot > 0) rep->mean_tpot_ns = e.sum_tpot_ns / (double) e.num_tpot;
+    rep->ttft    = summarize(e.ttft_ns, rep->completed);
+    rep->latency = summarize(e.latency_ns, rep->completed);
+    rep->decode_step = summarize(e.decode_step_ns, e.num_decode_steps);
+
+    event_queue_destroy(&e.events);
+    worker_pool_destroy(e.pool);
+    free(e.decode_step_ns);
+    free(e.latency_ns);
+    free(e.ttft_ns);
+    free(e.running);
+    free(e.waiting);
+    free(e.reqs);
+    return rep->peak;
+}
+
+KVStats run_simulation_report(KVBackend* backend,
+                              const SimConfig* cfg,
+                              const SequenceWork* work,
+                              SimReport* report) {
+    SimReport local;
+    SimReport* rep = report ? report : &local;
+    *rep = (SimReport){0};
+    memstat_reset_peak();
+    memstat_read(&rep->mem_start);
+
+    switch (cfg->driver) {
+    case SIM_DRIVER_CONTINUOUS:
+        run_continuous(backend, cfg, work, rep);
+        break;
+    case SIM_DRIVER_WORKER_POOL:
+        rep->peak = run_worker_pool(backend, cfg, work, rep);
+        break;
+    case SIM_DRIVER_BEAM:
+        run_beam_search(backend, cfg, work, rep);
+        break;
+    case SIM_DRIVER_SPECULATIVE:
+        run_speculative(backend, cfg, work, rep);
+        break;
+    case SIM_DRIVER_THREAD_PER_SEQ:
+    default:
+        rep->peak = run_thread_per_sequence(backend, cfg, work, rep);
+        break;
+    }
+    rep->counters = kv_counters(backend);
+    memstat_read(&rep->mem_end);
+    return rep->peak;
+}
+
+KVStats run_simulation(KVBackend* backend,
+                       const SimConfig* cfg,
+                       const SequenceWork* work) {
+    return run_simulation_report(backend, cfg, work, NULL);
+}
@@ -0,0 +1,143 @@
+#define _XOPEN_SOURCE 700   // sysconf(_SC_NPROCESSORS_ONLN)
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "worker_pool.h"
+
+typedef struct WorkerArgs {
+    struct WorkerPool* pool;
+    size_t index;
+} WorkerArgs;
+
+struct WorkerPool {
+    pthread_t*  threads;
+    WorkerArgs* args;
+    size_t num_workers;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t  start_cond;
+    pthread_cond_t  done_cond;
+    uint64_t generation;     // bumped once per parallel_for
+    size_t   running;        // workers still busy with the current job
+    int      shutdown;
+
+    // Current job; written under mutex before generation is bumped.
+    WorkerPoolFn fn;
+    void*  ctx;
+    size_t n;
+    size_t grain;
+    atomic_size_t cursor;
+};
+
+static void* worker_main(void* arg) {
+    WorkerArgs* a = (WorkerArgs*) arg;
+    WorkerPool* pool = a->pool;
+    uint64_t seen = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->mutex);
+        while (pool->generation == seen && !pool->shutdown) {
+            pthread_cond_wait(&pool->start_cond, &pool->mutex);
+        }
+        if (pool->shutdown) {
+            pthread_mutex_unlock(&pool->mutex);
+            return NULL;
+        }
+        seen = pool->generation;
+        WorkerPoolFn fn = pool->fn;
+        void*  ctx   = pool->ctx;
+        size_t n     = pool->n;
+        size_t grain = pool->grain;
+        pthread_mutex_unlock(&pool->mutex);
+
+        for (;;) {
+            size_t begin = atomic_fetch_add_explicit(&pool->cursor, grain,
+                                                     memory_order_relaxed);
+            if (begin >= n) break;
+            size_t end = begin + grain < n ? begin + grain : n;
+            fn(ctx, begin, end, a->index);
+        }
+
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->running == 0) {
+            pthread_cond_signal(&pool->done_cond);
+        }
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+WorkerPool* worker_pool_create(size_t num_workers) {
+    if (num_workers == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        num_workers = cores > 0 ? (size_t) cores : 1;
+    }
+
+    WorkerPool* pool = (WorkerPool*) calloc(1, sizeof(WorkerPool));
+    if (!pool) abort();
+    pool->num_workers = num_workers;
+    pool->threads = (pthread_t*) malloc(num_workers * sizeof(pthread_t));
+    pool->args    = (WorkerArgs*) malloc(num_workers * sizeof(WorkerArgs));
+    if (!pool->threads || !pool->args) abort();
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    atomic_init(&pool->cursor, 0);
+
+    for (size_t i = 0; i < num_workers; ++i) {
+        pool->args[i].pool  = pool;
+        pool->args[i].index = i;
+        if (pthread_create(&pool->threads[i], NULL, worker_main, &pool->args[i]) != 0) {
+            abort();
+        }
+    }
+    return pool;
+}
+
+void worker_pool_destroy(WorkerPool* pool) {
+    if (!pool) return;
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (size_t i = 0; i < pool->num_workers; ++i) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->start_cond);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->args);
+    free(pool->threads);
+    free(pool);
+}
+
+size_t worker_pool_size(const WorkerPool* pool) {
+    return pool->num_workers;
+}
+
+void worker_pool_parallel_for(WorkerPool* pool, size_t n,
+                              WorkerPoolFn fn, void* ctx) {
+    if (n == 0) return;
+
+    // ~8 chunks per worker keeps stragglers short without hammering cursor
+    size_t grain = n / (pool->num_workers * 8);
+    if (grain == 0) grain = 1;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->fn      = fn;
+    pool->ctx     = ctx;
+    pool->n       = n;
+    pool->grain   = grain;
+    pool->running = pool->num_workers;
+    atomic_store_explicit(&pool->cursor, 0, memory_order_relaxed);
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start_cond);
+    while (pool->running > 0) {
+        pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
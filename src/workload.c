@@ -1,29 +1,32 @@
 #include <stdlib.h>
+#include <math.h>
 #include "sim_config.h"
 #include "workload.h"
 
-static size_t align_down(size_t x, size_t a) {
-    if (a == 0) return 0;
-    return (x / a) * a;
-}
-
 SequenceWork* generate_workload(const SimConfig* cfg) {
     SequenceWork* w = (SequenceWork*) malloc(cfg->num_sequences * sizeof(SequenceWork));
     if (!w) abort();
 
-    const size_t tpp = cfg->tokens_per_page ? cfg->tokens_per_page : 1;
     const size_t max_ctx = cfg->max_context_tokens ? cfg->max_context_tokens : 2048;
 
     // Make prefix substantial but not the whole window (realistic sharing)
-    // e.g., 1024 tokens if max_ctx=2048 and tpp=16.
-    size_t target_prefix = max_ctx / 2;
-    size_t shareable_prefix = align_down(target_prefix, tpp);
+    // e.g., 1024 tokens if max_ctx=2048. It need not be page aligned.
+    size_t shareable_prefix = max_ctx / 2;
+
+    // Poisson arrivals: exponential gaps with mean 1/arrival_rate seconds
+    double arrival_s = 0.0;
+
+    // Multi-turn: request i is turn i / conversations of conversation
+    // i % conversations, so a conversation's turns are spread over the run.
+    size_t turns = cfg->conversation_turns > 1 ? cfg->conversation_turns : 1;
+    size_t conversations = (cfg->num_sequences + turns - 1) / turns;
 
     for (size_t i = 0; i < cfg->num_sequences; ++i) {
         int group = cfg->num_groups ? (int)(i % cfg->num_groups) : -1;
         w[i].shared_prompt_id = group;
 
         w[i].shared_prompt_tokens = (group >= 0) ? shareable_prefix : 0;
+        w[i].stream_id = i;
 
         // Prompt = shared_prefix + extra (but <= max_ctx)
         size_t extra_prompt = (cfg->max_prompt_extra > 0)
@@ -31,6 +34,19 @@ SequenceWork* generate_workload(const SimConfig* cfg) {
             : 0;
 
         size_t prompt = w[i].shared_prompt_tokens + extra_prompt;
+
+        // Later turns resend the previous turn's prompt and answer, unless
+        // that leaves no room to generate: then the user starts over.
+        if (i >= conversations) {
+            const SequenceWork* prev = &w[i - conversations];
+            size_t history = prev->prompt_tokens + prev->gen_tokens;
+            if (history + extra_prompt + cfg->min_gen_tokens <= max_ctx) {
+                w[i].shared_prompt_id     = prev->shared_prompt_id;
+                w[i].shared_prompt_tokens = prev->shared_prompt_tokens;
+                w[i].stream_id            = prev->stream_id;
+                prompt = history + extra_prompt;
+            }
+        }
         if (prompt > max_ctx) prompt = max_ctx;
         w[i].prompt_tokens = prompt;
 
@@ -46,6 +62,29 @@ SequenceWork* generate_workload(const SimConfig* cfg) {
 
         if (gen > remaining) gen = remaining;
         w[i].gen_tokens = gen;
+
+        if (cfg->arrival_rate > 0.0) {
+            double u = ((double) rand() + 1.0) / ((double) RAND_MAX + 1.0);
+            arrival_s += -log(u) / cfg->arrival_rate;
+        }
+        w[i].arrival_ns = (uint64_t) (arrival_s * 1e9);
+        w[i].priority   = rand() % 4;
     }
     return w;
 }
+
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+uint32_t workload_token(const SequenceWork* w, size_t pos) {
+    uint64_t source = (w->shared_prompt_id >= 0 && pos < w->shared_prompt_tokens)
+        ? (uint64_t) w->shared_prompt_id << 1
+        : (w->stream_id << 1) | 1;
+    return (uint32_t) mix64(mix64(source) + pos);
+}